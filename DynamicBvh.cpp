@@ -0,0 +1,287 @@
+#include "DynamicBvh.h"
+#include "Parallel.h"
+#include <algorithm>
+
+static inline float halfArea(const Vec3f& min, const Vec3f& max) {
+    Vec3f e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static inline void boxUnion(const Vec3f& minA, const Vec3f& maxA, const Vec3f& minB, const Vec3f& maxB,
+                            Vec3f& min, Vec3f& max) {
+    for (int i = 0; i < 3; i++) {
+        min[i] = std::min(minA[i], minB[i]);
+        max[i] = std::max(maxA[i], maxB[i]);
+    }
+}
+
+DynamicBvh::DynamicBvh() : root(-1), freeList(-1), numLeaves(0) {
+}
+
+int DynamicBvh::allocate() {
+    if (freeList < 0) {
+        nodes.push_back(Node());
+        return (int)nodes.size() - 1;
+    }
+    int node = freeList;
+    freeList = nodes[node].parent;
+    return node;
+}
+
+void DynamicBvh::release(int node) {
+    nodes[node].parent = freeList;
+    nodes[node].left = nodes[node].right = -1;
+    freeList = node;
+}
+
+void DynamicBvh::unite(int node) {
+    Node& n = nodes[node];
+    boxUnion(nodes[n.left].min, nodes[n.left].max, nodes[n.right].min, nodes[n.right].max, n.min, n.max);
+}
+
+void DynamicBvh::refitAncestors(int node, bool rotate) {
+    while (node >= 0) {
+        Vec3f min = nodes[node].min, max = nodes[node].max;
+        unite(node);
+        // the boxes above only change if this one did
+        if (!rotate && min == nodes[node].min && max == nodes[node].max) return;
+        if (rotate) this->rotate(node);
+        node = nodes[node].parent;
+    }
+}
+
+void DynamicBvh::rotate(int node) {
+    int children[2] = { nodes[node].left, nodes[node].right };
+    // the largest shrink of a child when its sibling takes the place of one
+    // of its children
+    float bestGain = 0.0f;
+    int bestChild = -1, bestGrandChild = -1;
+    for (int c = 0; c < 2; c++) {
+        const Node& child = nodes[children[c]];
+        if (child.isLeaf()) continue;
+        const Node& sibling = nodes[children[1 - c]];
+        float area = halfArea(child.min, child.max);
+        int grandChildren[2] = { child.left, child.right };
+        for (int g = 0; g < 2; g++) {
+            const Node& other = nodes[grandChildren[1 - g]];
+            Vec3f min, max;
+            boxUnion(sibling.min, sibling.max, other.min, other.max, min, max);
+            float gain = area - halfArea(min, max);
+            if (gain > bestGain) {
+                bestGain = gain;
+                bestChild = children[c];
+                bestGrandChild = grandChildren[g];
+            }
+        }
+    }
+    if (bestChild < 0) return;
+    int sibling = nodes[node].left == bestChild ? nodes[node].right : nodes[node].left;
+    if (nodes[node].left == sibling) nodes[node].left = bestGrandChild;
+    else nodes[node].right = bestGrandChild;
+    nodes[bestGrandChild].parent = node;
+    if (nodes[bestChild].left == bestGrandChild) nodes[bestChild].left = sibling;
+    else nodes[bestChild].right = sibling;
+    nodes[sibling].parent = bestChild;
+    unite(bestChild);
+}
+
+int DynamicBvh::insert(const Vec3f& min, const Vec3f& max, uint32_t item) {
+    int leaf = allocate();
+    nodes[leaf].min = min;
+    nodes[leaf].max = max;
+    nodes[leaf].parent = -1;
+    nodes[leaf].left = nodes[leaf].right = -1;
+    nodes[leaf].item = item;
+    numLeaves++;
+    if (root < 0) {
+        root = leaf;
+        return leaf;
+    }
+
+    // down from the root while a new parent further down costs less: the
+    // area of the new parent plus what the nodes above it grow by
+    int sibling = root;
+    while (!nodes[sibling].isLeaf()) {
+        const Node& n = nodes[sibling];
+        Vec3f unitedMin, unitedMax;
+        boxUnion(n.min, n.max, min, max, unitedMin, unitedMax);
+        float unitedArea = halfArea(unitedMin, unitedMax);
+        float here = unitedArea;
+        float inherited = unitedArea - halfArea(n.min, n.max);
+        float childCost[2];
+        int children[2] = { n.left, n.right };
+        for (int c = 0; c < 2; c++) {
+            const Node& child = nodes[children[c]];
+            Vec3f childMin, childMax;
+            boxUnion(child.min, child.max, min, max, childMin, childMax);
+            childCost[c] = halfArea(childMin, childMax) + inherited;
+            if (!child.isLeaf()) childCost[c] -= halfArea(child.min, child.max);
+        }
+        if (here <= childCost[0] && here <= childCost[1]) break;
+        sibling = childCost[0] <= childCost[1] ? n.left : n.right;
+    }
+
+    int oldParent = nodes[sibling].parent;
+    int parent = allocate();
+    Node& p = nodes[parent];
+    p.parent = oldParent;
+    p.left = sibling;
+    p.right = leaf;
+    boxUnion(nodes[sibling].min, nodes[sibling].max, min, max, p.min, p.max);
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+    if (oldParent < 0) root = parent;
+    else {
+        if (nodes[oldParent].left == sibling) nodes[oldParent].left = parent;
+        else nodes[oldParent].right = parent;
+        refitAncestors(oldParent, true);
+    }
+    return leaf;
+}
+
+void DynamicBvh::remove(int leaf) {
+    numLeaves--;
+    int parent = nodes[leaf].parent;
+    release(leaf);
+    if (parent < 0) {
+        root = -1;
+        return;
+    }
+    // the sibling takes the place of the parent
+    int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+    int grandParent = nodes[parent].parent;
+    nodes[sibling].parent = grandParent;
+    release(parent);
+    if (grandParent < 0) {
+        root = sibling;
+        return;
+    }
+    if (nodes[grandParent].left == parent) nodes[grandParent].left = sibling;
+    else nodes[grandParent].right = sibling;
+    refitAncestors(grandParent, true);
+}
+
+void DynamicBvh::refit(int leaf, const Vec3f& min, const Vec3f& max) {
+    nodes[leaf].min = min;
+    nodes[leaf].max = max;
+    refitAncestors(nodes[leaf].parent, false);
+}
+
+void DynamicBvh::clear() {
+    nodes.clear();
+    root = -1;
+    freeList = -1;
+    numLeaves = 0;
+}
+
+void DynamicBvh::collect(int node, vector<uint32_t>& visible) const {
+    vector<int> stack(1, node);
+    while (!stack.empty()) {
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+        if (n.isLeaf()) {
+            visible.push_back(n.item);
+            continue;
+        }
+        stack.push_back(n.right);
+        stack.push_back(n.left);
+    }
+}
+
+void DynamicBvh::cullSubtree(int node, unsigned int mask, const Frustum& frustum, vector<uint32_t>& visible) const {
+    struct Entry {
+        int node;
+        unsigned int mask;
+    };
+    vector<Entry> stack(1, Entry{ node, mask });
+    while (!stack.empty()) {
+        Entry e = stack.back();
+        stack.pop_back();
+        const Node& n = nodes[e.node];
+        if (e.mask && !frustum.boxVisible(n.min, n.max, e.mask)) continue;
+        if (n.isLeaf()) visible.push_back(n.item);
+        else if (e.mask == 0) collect(e.node, visible);
+        else {
+            // left first, in the order of the leaves
+            stack.push_back(Entry{ n.right, e.mask });
+            stack.push_back(Entry{ n.left, e.mask });
+        }
+    }
+}
+
+void DynamicBvh::cull(const Frustum& frustum, vector<uint32_t>& visible, unsigned int numThreads) const {
+    if (root < 0) return;
+    if (numThreads <= 1) {
+        cullSubtree(root, Frustum::ALL_PLANES, frustum, visible);
+        return;
+    }
+    // the top of the tree on this thread, down to a few subtrees per thread.
+    // children replace their parent in place, so the subtrees stay in the
+    // order of their leaves
+    struct Subtree {
+        int node;
+        unsigned int mask;
+    };
+    vector<Subtree> subtrees(1, Subtree{ root, (unsigned int)Frustum::ALL_PLANES });
+    vector<Subtree> next;
+    bool split = true;
+    while (split && subtrees.size() < 4 * numThreads) {
+        split = false;
+        next.clear();
+        for (Subtree s : subtrees) {
+            const Node& n = nodes[s.node];
+            if (n.isLeaf() || s.mask == 0) {
+                next.push_back(s);
+                continue;
+            }
+            if (!frustum.boxVisible(n.min, n.max, s.mask)) continue;
+            next.push_back(Subtree{ n.left, s.mask });
+            next.push_back(Subtree{ n.right, s.mask });
+            split = true;
+        }
+        subtrees.swap(next);
+    }
+    vector<vector<uint32_t> > results(subtrees.size());
+    unsigned int threads = (unsigned int)std::min<std::size_t>(numThreads, subtrees.size());
+    parallelFor(threads, [&](unsigned int t) {
+        for (std::size_t i = t; i < subtrees.size(); i += threads) {
+            cullSubtree(subtrees[i].node, subtrees[i].mask, frustum, results[i]);
+        }
+    });
+    for (const vector<uint32_t>& r : results) visible.insert(visible.end(), r.begin(), r.end());
+}
+
+std::size_t DynamicBvh::getNumLeaves() const {
+    return numLeaves;
+}
+
+std::size_t DynamicBvh::getHeight() const {
+    if (root < 0) return 0;
+    std::size_t height = 0;
+    vector<pair<int, std::size_t> > stack(1, make_pair(root, (std::size_t)1));
+    while (!stack.empty()) {
+        pair<int, std::size_t> e = stack.back();
+        stack.pop_back();
+        height = std::max(height, e.second);
+        if (nodes[e.first].isLeaf()) continue;
+        stack.push_back(make_pair(nodes[e.first].left, e.second + 1));
+        stack.push_back(make_pair(nodes[e.first].right, e.second + 1));
+    }
+    return height;
+}
+
+float DynamicBvh::getCost() const {
+    if (root < 0 || nodes[root].isLeaf()) return 0.0f;
+    double sum = 0.0;
+    vector<int> stack(1, root);
+    while (!stack.empty()) {
+        const Node& n = nodes[stack.back()];
+        stack.pop_back();
+        if (n.isLeaf()) continue;
+        sum += halfArea(n.min, n.max);
+        stack.push_back(n.left);
+        stack.push_back(n.right);
+    }
+    float rootArea = halfArea(nodes[root].min, nodes[root].max);
+    return rootArea > 0.0f ? (float)(sum / rootArea) : 0.0f;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// Dynamic bounding volume hierarchy of axis aligned boxes, for culling many
+// objects against the view frustum. Leaves are inserted and removed one at
+// a time: a new leaf walks down to the sibling that grows the surface area
+// of the tree the least, and the boxes above it are refitted. Rotations on
+// the way back up swap a child with a grandchild where that shrinks the
+// tree, so it stays tight whatever the order of insertions. A leaf whose box
+// changed is refitted in place, which keeps the tree valid but lets it get
+// looser with large moves; removing and inserting it again tightens it.
+// The nodes live in one array and are reused, leaf indices stay valid until
+// the leaf is removed.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Vec3.h"
+#include "Frustum.h"
+
+using namespace std;
+
+class DynamicBvh
+{
+public:
+    DynamicBvh();
+
+    // adds a leaf with the box (min, max) for item, returns the leaf index
+    int insert(const Vec3f& min, const Vec3f& max, uint32_t item);
+    void remove(int leaf);
+    // gives leaf a new box and refits the boxes above it
+    void refit(int leaf, const Vec3f& min, const Vec3f& max);
+    void clear();
+
+    // appends the items of the leaves whose boxes may be inside frustum.
+    // subtrees completely inside are taken without further tests. with more
+    // than one thread the subtrees below the top of the tree are culled in
+    // parallel; the order of the items does not depend on numThreads
+    void cull(const Frustum& frustum, vector<uint32_t>& visible, unsigned int numThreads = 1) const;
+
+    std::size_t getNumLeaves() const;
+    // nodes on the longest path from the root to a leaf
+    std::size_t getHeight() const;
+    // sum of the surface areas of the inner nodes over the one of the root,
+    // the cost of a ray or frustum walk the insertion keeps low
+    float getCost() const;
+
+private:
+    struct Node {
+        Vec3f min, max;
+        int parent;
+        // -1 for leaves. a free node keeps the next free one in parent
+        int left, right;
+        uint32_t item;
+        bool isLeaf() const { return left < 0; }
+    };
+
+    int allocate();
+    void release(int node);
+    // boxes of node and of its ancestors from their children. rotate also
+    // rotates each of them and walks up to the root
+    void refitAncestors(int node, bool rotate);
+    // swaps a child of node with a grandchild if that gives a smaller inner
+    // node below node
+    void rotate(int node);
+    // box of node from its children
+    void unite(int node);
+    // culls the subtree of node against the planes in mask
+    void cullSubtree(int node, unsigned int mask, const Frustum& frustum, vector<uint32_t>& visible) const;
+    // appends all items of the subtree of node
+    void collect(int node, vector<uint32_t>& visible) const;
+
+    vector<Node> nodes;
+    int root;
+    int freeList;
+    std::size_t numLeaves;
+};
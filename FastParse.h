@@ -0,0 +1,74 @@
+#pragma once
+
+// Allocation free helpers for scanning text files in place (e.g. a MappedFile).
+// All functions take a cursor p and the end of the valid range; nothing
+// beyond end is ever read, so the buffer does not need to be 0-terminated.
+
+#include <charconv>
+#include <cstring>
+#include <vector>
+
+// true for ' ', '\t', '\r' and '\v' / '\f', but not for '\n'
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) ++p;
+    return p;
+}
+
+// end of the line starting at p (position of '\n' or end)
+inline const char* findLineEnd(const char* p, const char* end) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+// splits [begin, end) into at most parts ranges that start at line beginnings.
+// bounds receives the range borders, i.e. range i is [bounds[i], bounds[i+1])
+inline void splitLines(const char* begin, const char* end, unsigned int parts, std::vector<const char*>& bounds) {
+    bounds.clear();
+    bounds.push_back(begin);
+    std::size_t size = end - begin;
+    for (unsigned int i = 1; i < parts; i++) {
+        const char* p = begin + size * i / parts;
+        if (p <= bounds.back()) continue;
+        p = findLineEnd(p - 1, end);
+        if (p == end) break;
+        bounds.push_back(p + 1);
+    }
+    bounds.push_back(end);
+}
+
+// skips the rest of the current token (up to the next blank or '\n')
+inline const char* skipToken(const char* p, const char* end) {
+    while (p < end && !isBlank(*p) && *p != '\n') ++p;
+    return p;
+}
+
+// parses a float at p (after optional blanks) and advances p behind it.
+// a token that is not completely a number (e.g. "-1.#QNAN0" written by old
+// MSVC runtimes) is skipped and yields 0. returns false if nothing valid was read.
+inline bool parseFloat(const char*& p, const char* end, float& value) {
+    p = skipBlanks(p, end);
+    if (p < end && *p == '+') ++p;
+    std::from_chars_result r = std::from_chars(p, end, value);
+    if (r.ec == std::errc() && (r.ptr == end || isBlank(*r.ptr) || *r.ptr == '\n')) {
+        p = r.ptr;
+        return true;
+    }
+    value = 0.0f;
+    p = skipToken(p, end);
+    return false;
+}
+
+// parses a (possibly signed) integer at p and advances p behind it.
+// in contrast to parseFloat the number may be followed by any character (e.g. '/').
+inline bool parseInt(const char*& p, const char* end, int& value) {
+    p = skipBlanks(p, end);
+    if (p < end && *p == '+') ++p;
+    std::from_chars_result r = std::from_chars(p, end, value);
+    if (r.ec != std::errc()) return false;
+    p = r.ptr;
+    return true;
+}
@@ -0,0 +1,93 @@
+#include "Frustum.h"
+#include "SimdMath.h"
+
+Frustum::Frustum(const ViewState& view) {
+    float planes[6][4];
+    view.frustumPlanes(planes);
+    for (int i = 0; i < 8; i++) {
+        const float* plane = planes[i < 6 ? i : i - 2];
+        a[i] = plane[0];
+        b[i] = plane[1];
+        c[i] = plane[2];
+        d[i] = plane[3];
+    }
+}
+
+Frustum Frustum::translated(const Vec3f& offset) const {
+    Frustum frustum = *this;
+    for (int i = 0; i < 8; i++) frustum.d[i] = d[i] + a[i] * offset.x + b[i] * offset.y + c[i] * offset.z;
+    return frustum;
+}
+
+bool Frustum::sphereVisible(const Vec3f& center, float radius) const {
+#ifdef HAVE_SSE2
+    __m128 x = _mm_set1_ps(center.x), y = _mm_set1_ps(center.y), z = _mm_set1_ps(center.z);
+    __m128 r = _mm_set1_ps(-radius);
+    __m128 outside = _mm_setzero_ps();
+    for (int i = 0; i < 8; i += 4) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(a + i), x), _mm_mul_ps(_mm_load_ps(b + i), y)),
+                                     _mm_add_ps(_mm_mul_ps(_mm_load_ps(c + i), z), _mm_load_ps(d + i)));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, r));
+    }
+    return _mm_movemask_ps(outside) == 0;
+#else
+    for (int i = 0; i < 6; i++) {
+        if (a[i] * center.x + b[i] * center.y + c[i] * center.z + d[i] < -radius) return false;
+    }
+    return true;
+#endif
+}
+
+bool Frustum::boxVisible(const Vec3f& min, const Vec3f& max) const {
+    // the corner farthest along each plane normal: the larger product per axis
+#ifdef HAVE_SSE2
+    __m128 minX = _mm_set1_ps(min.x), minY = _mm_set1_ps(min.y), minZ = _mm_set1_ps(min.z);
+    __m128 maxX = _mm_set1_ps(max.x), maxY = _mm_set1_ps(max.y), maxZ = _mm_set1_ps(max.z);
+    __m128 outside = _mm_setzero_ps();
+    for (int i = 0; i < 8; i += 4) {
+        __m128 pa = _mm_load_ps(a + i), pb = _mm_load_ps(b + i), pc = _mm_load_ps(c + i);
+        __m128 distance = _mm_add_ps(
+            _mm_add_ps(_mm_max_ps(_mm_mul_ps(pa, minX), _mm_mul_ps(pa, maxX)),
+                       _mm_max_ps(_mm_mul_ps(pb, minY), _mm_mul_ps(pb, maxY))),
+            _mm_add_ps(_mm_max_ps(_mm_mul_ps(pc, minZ), _mm_mul_ps(pc, maxZ)), _mm_load_ps(d + i)));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+    }
+    return _mm_movemask_ps(outside) == 0;
+#else
+    for (int i = 0; i < 6; i++) {
+        float distance = std::max(a[i] * min.x, a[i] * max.x) + std::max(b[i] * min.y, b[i] * max.y) +
+                         std::max(c[i] * min.z, c[i] * max.z) + d[i];
+        if (distance < 0.0f) return false;
+    }
+    return true;
+#endif
+}
+
+bool Frustum::boxVisible(const Vec3f& min, const Vec3f& max, unsigned& mask) const {
+    // farthest corner along each plane normal for outside, nearest for inside
+    unsigned outside = 0, inside = 0;
+#ifdef HAVE_SSE2
+    __m128 minX = _mm_set1_ps(min.x), minY = _mm_set1_ps(min.y), minZ = _mm_set1_ps(min.z);
+    __m128 maxX = _mm_set1_ps(max.x), maxY = _mm_set1_ps(max.y), maxZ = _mm_set1_ps(max.z);
+    for (int i = 0; i < 8; i += 4) {
+        __m128 pa = _mm_load_ps(a + i), pb = _mm_load_ps(b + i), pc = _mm_load_ps(c + i), pd = _mm_load_ps(d + i);
+        __m128 ax = _mm_mul_ps(pa, minX), bx = _mm_mul_ps(pa, maxX);
+        __m128 ay = _mm_mul_ps(pb, minY), by = _mm_mul_ps(pb, maxY);
+        __m128 az = _mm_mul_ps(pc, minZ), bz = _mm_mul_ps(pc, maxZ);
+        __m128 farthest = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by)), _mm_add_ps(_mm_max_ps(az, bz), pd));
+        __m128 nearest = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by)), _mm_add_ps(_mm_min_ps(az, bz), pd));
+        outside |= (unsigned)_mm_movemask_ps(_mm_cmplt_ps(farthest, _mm_setzero_ps())) << i;
+        inside |= (unsigned)_mm_movemask_ps(_mm_cmpge_ps(nearest, _mm_setzero_ps())) << i;
+    }
+#else
+    for (int i = 0; i < 6; i++) {
+        float ax = a[i] * min.x, bx = a[i] * max.x, ay = b[i] * min.y, by = b[i] * max.y;
+        float az = c[i] * min.z, bz = c[i] * max.z;
+        if (std::max(ax, bx) + std::max(ay, by) + std::max(az, bz) + d[i] < 0.0f) outside |= 1u << i;
+        if (std::min(ax, bx) + std::min(ay, by) + std::min(az, bz) + d[i] >= 0.0f) inside |= 1u << i;
+    }
+#endif
+    if (outside & mask) return false;
+    mask &= ~inside;
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// View frustum tests of whole meshes. The six planes of a ViewState are kept
+// as one array per plane coefficient, so SSE tests a sphere or a box against
+// four planes at once. Every test is conservative: it may call an invisible
+// volume visible, never the other way round.
+
+#include <cstddef>
+#include "Vec3.h"
+#include "ViewState.h"
+
+using namespace std;
+
+struct Frustum {
+    // bit i of a plane mask stands for plane i
+    enum { ALL_PLANES = 0x3f };
+
+    // plane i is a[i] x + b[i] y + c[i] z + d[i] >= 0 inside, in the object
+    // space of the view. planes 6 and 7 repeat 4 and 5 to fill two SSE registers
+    alignas(16) float a[8];
+    alignas(16) float b[8];
+    alignas(16) float c[8];
+    alignas(16) float d[8];
+
+    explicit Frustum(const ViewState& view);
+
+    // the frustum of view.translated(offset): the planes in coordinates
+    // moved by offset, without going through the matrices again
+    Frustum translated(const Vec3f& offset) const;
+
+    // false if the sphere lies completely outside one of the planes
+    bool sphereVisible(const Vec3f& center, float radius) const;
+    // false if the box lies completely outside one of the planes
+    bool boxVisible(const Vec3f& min, const Vec3f& max) const;
+    // boxVisible against the planes in mask only. clears the bits of the
+    // planes the box is completely inside of: boxes inside this one need
+    // not be tested against them, mask 0 is inside the whole frustum
+    bool boxVisible(const Vec3f& min, const Vec3f& max, unsigned& mask) const;
+};
+
+// what MeshObject::draw did with its meshes in one call
+struct FrustumCulling {
+    FrustumCulling() : visible(0), culled(0) {}
+    std::size_t visible;
+    std::size_t culled;
+};
@@ -0,0 +1,50 @@
+#include "GLShader.h"
+#include <iostream>
+#include <algorithm>
+#include <string>
+
+static GLuint compileShader(const char* name, GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok) return shader;
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    string log(std::max(length, 1), '\0');
+    glGetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, &log[0]);
+    cout << "buildProgram: " << name << ": " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment")
+         << " shader does not compile:" << endl << log.c_str() << endl;
+    glDeleteShader(shader);
+    return 0;
+}
+
+GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+                    const vector<const char*>& attributes) {
+    GLuint vertexShader = compileShader(name, GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = compileShader(name, GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vertexShader || !fragmentShader) {
+        if (vertexShader) glDeleteShader(vertexShader);
+        if (fragmentShader) glDeleteShader(fragmentShader);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    for (std::size_t i = 0; i < attributes.size(); i++) glBindAttribLocation(program, (GLuint)i, attributes[i]);
+    glLinkProgram(program);
+    // the program keeps them until it is deleted
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (ok) return program;
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    string log(std::max(length, 1), '\0');
+    glGetProgramInfoLog(program, (GLsizei)log.size(), nullptr, &log[0]);
+    cout << "buildProgram: " << name << ": does not link:" << endl << log.c_str() << endl;
+    glDeleteProgram(program);
+    return 0;
+}
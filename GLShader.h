@@ -0,0 +1,15 @@
+#pragma once
+
+// Compiling and linking GLSL programs. Needs a current GL context and
+// glewInit, like every other GL call.
+
+#include <GL/glew.h>
+#include <vector>
+
+using namespace std;
+
+// program of a vertex and a fragment shader. attributes[i] is bound to
+// location i. prints the info log and returns 0 if a stage does not compile
+// or the program does not link. name is used in the messages
+GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+                    const vector<const char*>& attributes);
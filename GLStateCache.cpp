@@ -0,0 +1,216 @@
+#include "GLStateCache.h"
+
+GLStateCache& GLStateCache::instance() {
+    static GLStateCache* cache = new GLStateCache();
+    return *cache;
+}
+
+// GL starts with the default vertex array object bound
+GLStateCache::GLStateCache() : vertexArray(0), frame(0) {
+}
+
+int GLStateCache::capabilityIndex(GLenum capability) {
+    if (capability >= GL_LIGHT0 && capability < GL_LIGHT0 + LIGHTS) return 5 + (int)(capability - GL_LIGHT0);
+    switch (capability) {
+    case GL_DEPTH_TEST: return 0;
+    case GL_LIGHTING: return 1;
+    case GL_COLOR_MATERIAL: return 2;
+    case GL_TEXTURE_2D: return 3;
+    case GL_CULL_FACE: return 4;
+    default: return -1;
+    }
+}
+
+int GLStateCache::clientStateIndex(GLenum array) {
+    switch (array) {
+    case GL_VERTEX_ARRAY: return 0;
+    case GL_NORMAL_ARRAY: return 1;
+    case GL_TEXTURE_COORD_ARRAY: return 2;
+    default: return -1;
+    }
+}
+
+int GLStateCache::lightParameterIndex(GLenum pname) {
+    switch (pname) {
+    case GL_AMBIENT: return 0;
+    case GL_DIFFUSE: return 1;
+    case GL_SPECULAR: return 2;
+    default: return -1;
+    }
+}
+
+int GLStateCache::materialParameterIndex(GLenum pname) {
+    switch (pname) {
+    case GL_SPECULAR: return 0;
+    case GL_EMISSION: return 1;
+    case GL_SHININESS: return 2;
+    default: return -1;
+    }
+}
+
+bool GLStateCache::count(bool issue) {
+    if (issue) current.issued++;
+    else current.skipped++;
+    return issue;
+}
+
+template<class T>
+bool GLStateCache::update(Shadow<T>& shadow, const T& value) {
+    if (shadow.known && shadow.value == value) return count(false);
+    shadow.known = true;
+    shadow.value = value;
+    return count(true);
+}
+
+void GLStateCache::forget(Shadow<GLuint>& shadow, GLuint name) {
+    if (shadow.value == name) shadow.known = false;
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled) {
+    int index = capabilityIndex(capability);
+    if (index < 0) count(true);
+    else if (!update(state.capabilities[index], enabled)) return;
+    if (enabled) glEnable(capability);
+    else glDisable(capability);
+}
+
+void GLStateCache::setClientState(GLenum array, bool enabled) {
+    int index = clientStateIndex(array);
+    if (index < 0 || vertexArray != 0) count(true);
+    else if (!update(state.clientStates[index], enabled)) return;
+    if (enabled) glEnableClientState(array);
+    else glDisableClientState(array);
+}
+
+void GLStateCache::setVertexAttribArray(GLuint index, bool enabled) {
+    if (index >= ATTRIB_ARRAYS || vertexArray != 0) count(true);
+    else if (!update(state.attribArrays[index], enabled)) return;
+    if (enabled) glEnableVertexAttribArray(index);
+    else glDisableVertexAttribArray(index);
+}
+
+void GLStateCache::shadeModel(GLenum mode) {
+    if (update(state.shadeModel, mode)) glShadeModel(mode);
+}
+
+void GLStateCache::colorMaterial(GLenum face, GLenum mode) {
+    array<GLenum, 2> value = {{ face, mode }};
+    if (update(state.colorMaterial, value)) glColorMaterial(face, mode);
+}
+
+void GLStateCache::lightModel(GLenum pname, const GLfloat* values) {
+    Color value = {{ values[0], values[1], values[2], values[3] }};
+    if (pname != GL_LIGHT_MODEL_AMBIENT) count(true);
+    else if (!update(state.lightModelAmbient, value)) return;
+    glLightModelfv(pname, values);
+}
+
+void GLStateCache::light(GLenum light, GLenum pname, const GLfloat* values) {
+    Color value = {{ values[0], values[1], values[2], values[3] }};
+    int index = lightParameterIndex(pname);
+    if (index < 0 || light < GL_LIGHT0 || light >= GL_LIGHT0 + LIGHTS) count(true);
+    else if (!update(state.lights[light - GL_LIGHT0][index], value)) return;
+    glLightfv(light, pname, values);
+}
+
+void GLStateCache::material(GLenum face, GLenum pname, const GLfloat* values) {
+    int index = materialParameterIndex(pname);
+    if (index < 0) {
+        count(true);
+        glMaterialfv(face, pname, values);
+        return;
+    }
+    Color value = {{ values[0], 0.0f, 0.0f, 0.0f }};
+    if (pname != GL_SHININESS) value = Color{{ values[0], values[1], values[2], values[3] }};
+    // GL_FRONT_AND_BACK is skipped only if both faces have the values
+    bool changed = false;
+    for (int side = 0; side < 2; side++) {
+        if (face == (side == 0 ? GL_BACK : GL_FRONT)) continue;
+        Shadow<Color>& shadow = state.materials[side][index];
+        changed = changed || !shadow.known || shadow.value != value;
+        shadow.known = true;
+        shadow.value = value;
+    }
+    if (count(changed)) glMaterialfv(face, pname, values);
+}
+
+void GLStateCache::bindTexture(GLuint texture) {
+    if (update(state.texture, texture)) glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    Shadow<GLuint>* shadow = target == GL_ARRAY_BUFFER ? &state.arrayBuffer
+                             : target == GL_ELEMENT_ARRAY_BUFFER && vertexArray == 0 ? &state.elementBuffer
+                             : nullptr;
+    if (!shadow) count(true);
+    else if (!update(*shadow, buffer)) return;
+    glBindBuffer(target, buffer);
+}
+
+void GLStateCache::bindVertexArray(GLuint array) {
+    // also keeps GL 2 contexts, which have no vertex array objects, off glBindVertexArray
+    if (!count(array != vertexArray)) return;
+    vertexArray = array;
+    glBindVertexArray(array);
+}
+
+void GLStateCache::useProgram(GLuint program) {
+    if (update(state.program, program)) glUseProgram(program);
+}
+
+void GLStateCache::deleteBuffers(GLsizei n, const GLuint* buffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        forget(state.arrayBuffer, buffers[i]);
+        forget(state.elementBuffer, buffers[i]);
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    // deleting the bound object binds the default one again
+    for (GLsizei i = 0; i < n; i++) {
+        if (arrays[i] == vertexArray) vertexArray = 0;
+    }
+    glDeleteVertexArrays(n, arrays);
+}
+
+void GLStateCache::deleteTextures(GLsizei n, const GLuint* textures) {
+    for (GLsizei i = 0; i < n; i++) forget(state.texture, textures[i]);
+    glDeleteTextures(n, textures);
+}
+
+void GLStateCache::resetBindings() {
+    // the arrays of the default vertex array object
+    bindVertexArray(0);
+    setClientState(GL_VERTEX_ARRAY, false);
+    setClientState(GL_NORMAL_ARRAY, false);
+    setClientState(GL_TEXTURE_COORD_ARRAY, false);
+    for (GLuint i = 0; i < 3; i++) setVertexAttribArray(i, false);
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    useProgram(0);
+    bindTexture(0);
+    setEnabled(GL_TEXTURE_2D, false);
+}
+
+void GLStateCache::invalidate() {
+    state = State();
+}
+
+void GLStateCache::beginFrame() {
+    last = current;
+    current = Counts();
+    frame++;
+}
+
+std::size_t GLStateCache::frameNumber() const {
+    return frame;
+}
+
+const GLStateCache::Counts& GLStateCache::lastFrame() const {
+    return last;
+}
+
+const GLStateCache::Counts& GLStateCache::currentFrame() const {
+    return current;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+// Shadow of the GL state the draw paths of TriangleMesh change. Every setter
+// issues its GL call only if the value differs from the last one set
+// through the cache, and counts the calls it issued and the ones it skipped
+// per frame. Draw paths set the state they need and leave it; resetBindings
+// brings it back to what drawing code outside the cache expects. State
+// changed behind the cache's back has to be reported with invalidate. GL
+// thread only.
+
+#include <GL/glew.h>
+#include <array>
+#include <cstddef>
+
+using namespace std;
+
+class GLStateCache
+{
+public:
+    struct Counts {
+        Counts() : issued(0), skipped(0) {}
+        std::size_t issued;
+        std::size_t skipped;
+    };
+
+    static GLStateCache& instance();
+
+    // glEnable or glDisable
+    void setEnabled(GLenum capability, bool enabled);
+    // glEnableClientState or glDisableClientState
+    void setClientState(GLenum array, bool enabled);
+    // glEnableVertexAttribArray or glDisableVertexAttribArray
+    void setVertexAttribArray(GLuint index, bool enabled);
+    void shadeModel(GLenum mode);
+    void colorMaterial(GLenum face, GLenum mode);
+    // glLightModelfv with four values
+    void lightModel(GLenum pname, const GLfloat* values);
+    // glLightfv with four values. not for GL_POSITION, which GL transforms
+    // by the modelview matrix of the call
+    void light(GLenum light, GLenum pname, const GLfloat* values);
+    // glMaterialfv with four values, one for GL_SHININESS
+    void material(GLenum face, GLenum pname, const GLfloat* values);
+    // GL_TEXTURE_2D of texture unit 0
+    void bindTexture(GLuint texture);
+    // GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindVertexArray(GLuint array);
+    void useProgram(GLuint program);
+
+    // glDelete* that forget the names too: GL unbinds deleted objects and
+    // hands their names out again
+    void deleteBuffers(GLsizei n, const GLuint* buffers);
+    void deleteVertexArrays(GLsizei n, const GLuint* arrays);
+    void deleteTextures(GLsizei n, const GLuint* textures);
+
+    // disables the vertex arrays of the draw paths and GL_TEXTURE_2D and
+    // unbinds buffers, vertex array, program and texture
+    void resetBindings();
+    // forgets all values, the next call of every setter is issued. the bound
+    // vertex array object is kept, ones other than 0 have to be bound
+    // through the cache
+    void invalidate();
+
+    // starts the counts of a new frame
+    void beginFrame();
+    // frames begun so far, 0 before the first beginFrame
+    std::size_t frameNumber() const;
+    const Counts& lastFrame() const;
+    const Counts& currentFrame() const;
+
+private:
+    GLStateCache();
+
+    // a value set through the cache, unknown until the first call
+    template<class T>
+    struct Shadow {
+        Shadow() : known(false), value() {}
+        bool known;
+        T value;
+    };
+    typedef array<GLfloat, 4> Color;
+    enum { CAPABILITIES = 13, CLIENT_STATES = 3, ATTRIB_ARRAYS = 8, LIGHTS = 8, LIGHT_PARAMETERS = 3,
+           MATERIAL_PARAMETERS = 3 };
+    // the shadowed state, one slot per capability, array, light and
+    // parameter the draw paths use. calls for others are issued unchecked
+    struct State {
+        Shadow<bool> capabilities[CAPABILITIES];
+        Shadow<bool> clientStates[CLIENT_STATES];
+        Shadow<bool> attribArrays[ATTRIB_ARRAYS];
+        Shadow<GLenum> shadeModel;
+        Shadow<array<GLenum, 2> > colorMaterial;
+        Shadow<Color> lightModelAmbient;
+        Shadow<Color> lights[LIGHTS][LIGHT_PARAMETERS];
+        // front and back
+        Shadow<Color> materials[2][MATERIAL_PARAMETERS];
+        Shadow<GLuint> texture;
+        Shadow<GLuint> arrayBuffer, elementBuffer;
+        Shadow<GLuint> program;
+    };
+
+    // slot of capability, array or parameter in State, -1 if not shadowed
+    static int capabilityIndex(GLenum capability);
+    static int clientStateIndex(GLenum array);
+    static int lightParameterIndex(GLenum pname);
+    // not GL_AMBIENT and GL_DIFFUSE, glColor changes them with GL_COLOR_MATERIAL
+    static int materialParameterIndex(GLenum pname);
+
+    // counts the call as issued or skipped, returns issue
+    bool count(bool issue);
+    // true (and value stored) if value differs from the one in shadow.
+    // counts the call as issued or skipped
+    template<class T>
+    bool update(Shadow<T>& shadow, const T& value);
+    // marks shadow unknown if it holds name
+    static void forget(Shadow<GLuint>& shadow, GLuint name);
+
+    State state;
+    // the arrays and the element buffer belong to the bound vertex array
+    // object, only the ones of the default object 0 are shadowed
+    GLuint vertexArray;
+    Counts current, last;
+    std::size_t frame;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+// Fast non-cryptographic 64 bit hash for file contents (cache keys).
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+inline uint64_t hashRotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t hashMix(uint64_t h, uint64_t word) {
+    h ^= word * 0xC2B2AE3D27D4EB4Full;
+    return hashRotl(h, 31) * 0x9E3779B185EBCA87ull;
+}
+
+// hashes size bytes at data. four independent lanes keep the multipliers busy
+inline uint64_t hashBytes(const void* data, std::size_t size, uint64_t seed = 0) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + size;
+    uint64_t h0 = seed ^ 0x9E3779B185EBCA87ull, h1 = seed ^ 0xC2B2AE3D27D4EB4Full;
+    uint64_t h2 = seed ^ 0x165667B19E3779F9ull, h3 = seed ^ 0x27D4EB2F165667C5ull;
+    while (end - p >= 32) {
+        uint64_t w[4];
+        memcpy(w, p, 32);
+        h0 = hashMix(h0, w[0]);
+        h1 = hashMix(h1, w[1]);
+        h2 = hashMix(h2, w[2]);
+        h3 = hashMix(h3, w[3]);
+        p += 32;
+    }
+    uint64_t h = hashRotl(h0, 1) + hashRotl(h1, 7) + hashRotl(h2, 12) + hashRotl(h3, 18);
+    h = hashMix(h, (uint64_t)size);
+    while (end - p >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = hashMix(h, w);
+        p += 8;
+    }
+    if (p < end) {
+        uint64_t w = 0;
+        memcpy(&w, p, end - p);
+        h = hashMix(h, w);
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 29;
+    return h;
+}
@@ -0,0 +1,37 @@
+#include "LaserScan.h"
+#include "SimdMath.h"
+
+static const float degToRad = 0.01745329251994329577f;
+
+void laserScanToCartesian(const float* alpha, const float* beta, const float* gamma,
+                          std::size_t count, float baseline, Vec3f* points) {
+    std::size_t i = 0;
+#ifdef HAVE_SSE2
+    const __m128 toRad = _mm_set1_ps(degToRad);
+    const __m128 minusBaseline = _mm_set1_ps(-baseline);
+    const __m128 halfBaseline = _mm_set1_ps(0.5f * baseline);
+    for (; i + 4 <= count; i += 4) {
+        __m128 tanAlpha = tan_ps(_mm_mul_ps(_mm_loadu_ps(alpha + i), toRad));
+        __m128 tanBeta = tan_ps(_mm_mul_ps(_mm_loadu_ps(beta + i), toRad));
+        __m128 tanGamma = tan_ps(_mm_mul_ps(_mm_loadu_ps(gamma + i), toRad));
+        __m128 z = _mm_div_ps(minusBaseline, _mm_add_ps(tanAlpha, tanBeta));
+        __m128 x = _mm_add_ps(halfBaseline, _mm_mul_ps(z, tanBeta));
+        __m128 y = _mm_mul_ps(z, tanGamma);
+        // transpose to x,y,z triples
+        float xs[4], ys[4], zs[4];
+        _mm_storeu_ps(xs, x);
+        _mm_storeu_ps(ys, y);
+        _mm_storeu_ps(zs, z);
+        for (int k = 0; k < 4; k++) {
+            points[i + k] = Vec3f(xs[k], ys[k], zs[k]);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        float tanAlpha = tanf(alpha[i] * degToRad);
+        float tanBeta = tanf(beta[i] * degToRad);
+        float tanGamma = tanf(gamma[i] * degToRad);
+        float z = -baseline / (tanAlpha + tanBeta);
+        points[i] = Vec3f(0.5f * baseline + z * tanBeta, z * tanGamma, z);
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Conversion of laser scanner measurements (LSA files) to 3D points.
+// Laser and camera sit on the x axis, baseline apart. alpha and beta are the
+// horizontal angles of laser and camera ray, gamma the vertical angle (all in
+// degrees). The point is where both rays meet:
+//   z = -baseline / (tan(alpha) + tan(beta))
+//   x = baseline / 2 + z * tan(beta)
+//   y = z * tan(gamma)
+
+#include <cstddef>
+#include "Vec3.h"
+
+using namespace std;
+
+// converts count angle triples given as separate arrays into points.
+// uses SSE for blocks of four points
+void laserScanToCartesian(const float* alpha, const float* beta, const float* gamma,
+                          std::size_t count, float baseline, Vec3f* points);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+// The mapping is released by close() or the destructor.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // maps filename into memory. returns false if it can not be opened
+    bool open(const char* filename);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return begin; }
+    const char* end() const { return begin + length; }
+    std::size_t size() const { return length; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* begin;
+    std::size_t length;
+    bool opened;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
@@ -0,0 +1,773 @@
+// Command line benchmarks of the mesh code.
+//
+//   meshbench layout <mesh file> [repeats] [--gl]
+//   meshbench overdraw <mesh file> [views] [resolution]
+//   meshbench lod <mesh file> [threshold]
+//   meshbench normals <mesh file> [repeats]
+//   meshbench topology <mesh file> [repeats]
+//   meshbench quantize <mesh file> [repeats] [--gl]
+//   meshbench meshlets <mesh file> [views]
+//   meshbench draw <mesh file> [repeats]
+//
+// layout: compares the separate and the interleaved vertex layout of
+// TriangleMesh on the CPU passes (normals, bounds, transform) and on the
+// indexed vertex fetch of a draw call with client arrays. --gl also times
+// drawArray (client arrays) and drawBuffers (buffer objects, uploaded before
+// the first run) in a GLUT window. Every pass prints the best of repeats runs.
+//
+// overdraw: rasterizes the mesh from views directions without a GPU and
+// prints the shaded fragments per covered pixel and the ACMR of the file
+// order, the vertex cache order and the overdraw order at several thresholds.
+//
+// lod: builds the levels of detail and prints their triangles, their error
+// relative to the bounding box diagonal, their overdraw and ACMR and the
+// distance (in bounding box diagonals) from which draw picks them for a
+// 1080 pixel high viewport with a 60 degree field of view and an error
+// threshold of threshold pixels.
+//
+// normals: times the serial normal computation against the parallel one
+// (topology build plus gather) on 1, 2, 4, ... threads up to the core count
+// and checks that all of them give the same bits. Then it moves regions of
+// 1, 100 and 10000 vertices and times updateNormals against a full
+// calculateNormals, again checking the bits.
+//
+// topology: times the MeshTopology build on 1, 2, 4, ... threads, prints its
+// memory per triangle and the border and non manifold edges, and times one
+// ring queries over all vertices.
+//
+// quantize: converts the mesh to the quantized vertex layout and prints the
+// vertex memory before and after and the largest position (also relative to
+// the bounding box diagonal), normal and texture coordinate errors. --gl also
+// times drawArray of both layouts.
+//
+// meshlets: builds the meshlets, prints their sizes and culls them for views
+// cameras on a sphere around the mesh (60 degree field of view, looking at
+// its center): far ones see all of it, near ones stand at 0.4 bounding box
+// diagonals from the center. Prints the triangles outside the frustum,
+// culled as back facing and drawn, the share of back facing triangles as
+// the bound for the cone test, and the time per culling pass.
+//
+// draw: draws the full mesh lit by one light in a GLUT window with every
+// draw mode of TriangleMesh (immediate mode, client arrays and buffer
+// objects with the fixed function pipeline, and the shaders) and prints the
+// time of the draw calls alone and of a whole frame up to glFinish.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "TriangleMesh.h"
+#include "VertexLayout.h"
+#include "MeshOptimizer.h"
+#include "MeshTopology.h"
+#include "Parallel.h"
+#include "Meshlets.h"
+#include "ViewState.h"
+#include "GLStateCache.h"
+#include "DynamicBvh.h"
+#include "Frustum.h"
+
+using namespace std;
+
+// buffers stored here may be changed by any call the compiler can not see
+// into, so repeated runs of a pass over them are not folded into one
+static const void* volatile escaped;
+
+// best time of repeats runs of fn in milliseconds
+template<class F>
+static double bestOf(int repeats, F fn) {
+    double best = 0.0;
+    for (int i = 0; i < repeats; i++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fn();
+        double ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+static bool loadMesh(TriangleMesh& mesh, const string& filename) {
+    string extension = filename.substr(std::min(filename.size(), filename.rfind('.') + 1));
+    for (char& c : extension) c = (char)tolower((unsigned char)c);
+    if (extension == "obj") mesh.loadOBJ(filename.c_str(), 0);
+    else if (extension == "off") mesh.loadOFF(filename.c_str(), 0);
+    else if (extension == "lsa") mesh.loadLSA(filename.c_str(), 0);
+    else {
+        cout << "meshbench: unknown file type " << filename << endl;
+        return false;
+    }
+    return !mesh.getTriangles().empty();
+}
+
+// normals from scratch, as after a deformation
+template<class Layout>
+static void normalsPass(const Layout& layout, const vector<Vec3i>& triangles, std::size_t numVertices) {
+    for (std::size_t i = 0; i < numVertices; i++) layout.normal(i).clear();
+    accumulateNormals(layout, triangles.data(), triangles.size(), numVertices);
+}
+
+// rotation about z of positions and normals
+template<class Layout>
+static void transformPass(const Layout& layout, std::size_t numVertices, float angle) {
+    const float c = cosf(angle), s = sinf(angle);
+    for (std::size_t i = 0; i < numVertices; i++) {
+        Vec3f& p = layout.position(i);
+        Vec3f& n = layout.normal(i);
+        p = Vec3f(c * p.x - s * p.y, s * p.x + c * p.y, p.z);
+        n = Vec3f(c * n.x - s * n.y, s * n.x + c * n.y, n.z);
+    }
+}
+
+// what the driver does for glDrawElements with client arrays: gathers the
+// attributes of every index into a (here: ring) buffer for the GPU
+template<class Layout>
+static float fetchPass(const Layout& layout, const vector<Vec3i>& triangles, vector<float>& ring) {
+    const std::size_t ringVertices = ring.size() / 8;
+    std::size_t slot = 0;
+    for (const Vec3i& t : triangles) {
+        for (int k = 0; k < 3; k++) {
+            const Vec3f& p = layout.position(t[k]);
+            const Vec3f& n = layout.normal(t[k]);
+            const TriangleMesh::Tex2D& uv = layout.tex(t[k]);
+            float* out = &ring[8 * slot];
+            out[0] = p.x; out[1] = p.y; out[2] = p.z;
+            out[3] = n.x; out[4] = n.y; out[5] = n.z;
+            out[6] = uv.u; out[7] = uv.v;
+            if (++slot == ringVertices) slot = 0;
+        }
+    }
+    float sum = 0.0f;
+    for (float f : ring) sum += f;
+    return sum;
+}
+
+static void printRow(const char* pass, double separate, double interleaved) {
+    cout << left << setw(12) << pass << right << fixed << setprecision(3)
+         << setw(14) << separate << setw(16) << interleaved
+         << setw(10) << setprecision(2) << separate / interleaved << "x" << endl;
+}
+
+static int benchLayout(const string& filename, int repeats, bool gl) {
+    TriangleMesh mesh;
+    if (!loadMesh(mesh, filename)) return 1;
+    vector<Vec3i> triangles = mesh.getTriangles();
+
+    // both layouts of the same data
+    vector<Vec3f> positions = mesh.getPoints();
+    vector<Vec3f> normals = mesh.getNormals();
+    vector<TriangleMesh::Tex2D> textures(positions.size(), TriangleMesh::Tex2D());
+    TriangleMesh::PackedVertices packed(positions.size());
+    for (std::size_t i = 0; i < positions.size(); i++) {
+        packed[i].position = positions[i];
+        packed[i].normal = normals[i];
+    }
+    const std::size_t n = positions.size();
+    SeparateLayout separate(positions.data(), normals.data(), textures.data());
+    PackedLayout interleaved(packed.data());
+    escaped = positions.data();
+    escaped = normals.data();
+    escaped = textures.data();
+    escaped = packed.data();
+
+    cout << filename << ": " << n << " vertices, " << triangles.size() << " triangles, best of "
+         << repeats << " runs" << endl;
+    cout << left << setw(12) << "pass" << right << setw(14) << "separate ms" << setw(16) << "interleaved ms"
+         << setw(11) << "speedup" << endl;
+
+    printRow("normals",
+             bestOf(repeats, [&] { normalsPass(separate, triangles, n); }),
+             bestOf(repeats, [&] { normalsPass(interleaved, triangles, n); }));
+    Vec3f boundsMin, boundsMax;
+    escaped = &boundsMin;
+    escaped = &boundsMax;
+    printRow("bounds",
+             bestOf(repeats, [&] { computeBounds(separate, n, boundsMin, boundsMax); }),
+             bestOf(repeats, [&] { computeBounds(interleaved, n, boundsMin, boundsMax); }));
+    printRow("transform",
+             bestOf(repeats, [&] { transformPass(separate, n, 0.01f); }),
+             bestOf(repeats, [&] { transformPass(interleaved, n, 0.01f); }));
+    vector<float> ring(8 * 4096);
+    float checksum = 0.0f;
+    printRow("fetch",
+             bestOf(repeats, [&] { checksum += fetchPass(separate, triangles, ring); }),
+             bestOf(repeats, [&] { checksum += fetchPass(interleaved, triangles, ring); }));
+
+    if (gl) {
+        // glFinish makes the time include the driver pulling the arrays
+        double drawSeparate = bestOf(repeats, [&] { mesh.drawArray(); glFinish(); });
+        mesh.drawBuffers();
+        double buffersSeparate = bestOf(repeats, [&] { mesh.drawBuffers(); glFinish(); });
+        mesh.setInterleaved(true);
+        double drawInterleaved = bestOf(repeats, [&] { mesh.drawArray(); glFinish(); });
+        mesh.drawBuffers();
+        double buffersInterleaved = bestOf(repeats, [&] { mesh.drawBuffers(); glFinish(); });
+        printRow("draw", drawSeparate, drawInterleaved);
+        printRow("draw VBO", buffersSeparate, buffersInterleaved);
+    }
+    // keeps the passes from being optimized away
+    if (checksum == 1.0f || boundsMin.x > boundsMax.x) cout << endl;
+    return 0;
+}
+
+static void printOverdrawRow(const char* order, const vector<Vec3i>& triangles, const vector<Vec3f>& positions,
+                             int views, int resolution) {
+    VertexCacheStats cache = analyzeVertexCache(triangles, positions.size());
+    OverdrawStats overdraw = analyzeOverdraw(triangles, &positions[0].x, sizeof(Vec3f), positions.size(),
+                                             views, resolution);
+    cout << left << setw(24) << order << right << fixed << setprecision(3)
+         << setw(10) << overdraw.overdraw << setw(10) << cache.acmr << endl;
+}
+
+static int benchOverdraw(const string& filename, int views, int resolution) {
+    TriangleMesh mesh;
+    mesh.setUseMeshCache(false);
+    mesh.setOptimizeOnLoad(false);
+    if (!loadMesh(mesh, filename)) return 1;
+    const vector<Vec3f>& positions = mesh.getPoints();
+
+    cout << filename << ": " << mesh.getTriangles().size() << " triangles, " << views << " views at "
+         << resolution << "x" << resolution << endl;
+    cout << left << setw(24) << "order" << right << setw(10) << "overdraw" << setw(10) << "ACMR" << endl;
+    printOverdrawRow("file", mesh.getTriangles(), positions, views, resolution);
+    vector<Vec3i> cacheOrder = mesh.getTriangles();
+    optimizeVertexCache(cacheOrder, positions.size());
+    printOverdrawRow("vertex cache", cacheOrder, positions, views, resolution);
+    const float thresholds[] = { 1.0f, 1.05f, 1.2f, 1.5f, 2.0f, 3.0f };
+    for (float threshold : thresholds) {
+        vector<Vec3i> order = cacheOrder;
+        std::size_t clusters = optimizeOverdraw(order, &positions[0].x, sizeof(Vec3f), positions.size(), threshold);
+        string name = "threshold " + to_string(threshold).substr(0, 4) + " (" + to_string(clusters) + ")";
+        printOverdrawRow(name.c_str(), order, positions, views, resolution);
+    }
+    return 0;
+}
+
+static int benchLod(const string& filename, float threshold) {
+    TriangleMesh mesh;
+    mesh.setUseMeshCache(false);
+    mesh.setBuildLods(false);
+    if (!loadMesh(mesh, filename)) return 1;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mesh.buildLods();
+    double ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+    const vector<Vec3f>& positions = mesh.getPoints();
+    float diagonal = (mesh.getBoundsMax() - mesh.getBoundsMin()).length();
+    // pixels per unit at distance 1, as ViewState::projectedSize computes it
+    const float pixelsPerUnit = 1.0f / tanf(30.0f * (float)M_PI / 180.0f) * 1080.0f * 0.5f;
+
+    cout << filename << ": " << mesh.getLods().size() << " levels in " << fixed << setprecision(1) << ms << " ms" << endl;
+    cout << left << setw(8) << "level" << right << setw(12) << "triangles" << setw(12) << "error" << setw(10)
+         << "overdraw" << setw(10) << "ACMR" << setw(12) << "distance" << endl;
+    for (std::size_t i = 0; i <= mesh.getLods().size(); i++) {
+        const vector<Vec3i>& triangles = i == 0 ? mesh.getTriangles() : mesh.getLods()[i - 1].triangles;
+        float error = i == 0 ? 0.0f : mesh.getLods()[i - 1].error;
+        VertexCacheStats cache = analyzeVertexCache(triangles, positions.size());
+        OverdrawStats overdraw = analyzeOverdraw(triangles, &positions[0].x, sizeof(Vec3f), positions.size());
+        // distance of the nearest bounding sphere point at which the error is threshold pixels
+        float distance = error * pixelsPerUnit / threshold + 0.5f * diagonal;
+        cout << left << setw(8) << i << right << setw(12) << triangles.size() << setw(12) << scientific
+             << setprecision(2) << error / diagonal << fixed << setprecision(3) << setw(10) << overdraw.overdraw
+             << setw(10) << cache.acmr << setw(12) << setprecision(1) << distance / diagonal << endl;
+    }
+    return 0;
+}
+
+static int benchNormals(const string& filename, int repeats) {
+    TriangleMesh mesh;
+    mesh.setUseMeshCache(false);
+    mesh.setOptimizeOnLoad(false);
+    mesh.setBuildLods(false);
+    mesh.setBuildMeshlets(false);
+    if (!loadMesh(mesh, filename)) return 1;
+    const vector<Vec3i>& triangles = mesh.getTriangles();
+    vector<Vec3f> positions = mesh.getPoints();
+    const std::size_t n = positions.size();
+    vector<Vec3f> serialNormals(n), normals(n);
+    SeparateLayout serial(positions.data(), serialNormals.data(), nullptr);
+    SeparateLayout parallel(positions.data(), normals.data(), nullptr);
+    escaped = serialNormals.data();
+    escaped = normals.data();
+
+    cout << filename << ": " << n << " vertices, " << triangles.size() << " triangles, best of "
+         << repeats << " runs" << endl;
+    cout << left << setw(12) << "threads" << right << setw(12) << "total ms" << setw(12) << "topology ms"
+         << setw(10) << "speedup" << setw(10) << "same" << endl;
+    double serialMs = bestOf(repeats, [&] { normalsPass(serial, triangles, n); });
+    cout << left << setw(12) << "serial" << right << fixed << setprecision(3) << setw(12) << serialMs << endl;
+    for (unsigned int threads = 1;; threads = std::min(2 * threads, defaultThreadCount())) {
+        MeshTopology topology;
+        double topologyMs = bestOf(repeats, [&] {
+            topology.build(triangles.data(), triangles.size(), n, threads);
+        });
+        double ms = bestOf(repeats, [&] {
+            for (std::size_t i = 0; i < n; i++) normals[i].clear();
+            topology.build(triangles.data(), triangles.size(), n, threads);
+            accumulateNormals(parallel, triangles.data(), topology, threads);
+        });
+        bool same = memcmp(normals.data(), serialNormals.data(), n * sizeof(Vec3f)) == 0;
+        cout << left << setw(12) << threads << right << setw(12) << setprecision(3) << ms << setw(12) << topologyMs
+             << setw(9) << setprecision(2) << serialMs / ms << "x" << setw(10) << (same ? "yes" : "NO") << endl;
+        if (threads == defaultThreadCount()) break;
+    }
+
+    // edits of growing size. the first updateNormals builds the adjacency
+    mesh.markDirty(0, 1);
+    mesh.updateNormals();
+    cout << left << setw(12) << "edit" << right << setw(12) << "update ms" << setw(12) << "normals"
+         << setw(10) << "speedup" << setw(10) << "same" << endl;
+    const std::size_t edits[] = { 1, 100, 10000 };
+    for (std::size_t edit : edits) {
+        edit = std::min(edit, n);
+        // a run of vertices from the middle, neighbours in most files
+        std::size_t first = n / 2 + edit > n ? 0 : n / 2;
+        std::size_t numUpdated = 0;
+        double ms = bestOf(repeats, [&] {
+            for (std::size_t v = first; v < first + edit; v++) {
+                Vec3f p = mesh.getPoints()[v];
+                p.z += 0.001f;
+                mesh.setVertexPosition(v, p);
+            }
+            numUpdated = mesh.updateNormals();
+        });
+        vector<Vec3f> moved = mesh.getPoints();
+        vector<Vec3f> fullNormals(n);
+        SeparateLayout full(moved.data(), fullNormals.data(), nullptr);
+        double fullMs = bestOf(repeats, [&] { normalsPass(full, triangles, n); });
+        bool same = memcmp(fullNormals.data(), mesh.getNormals().data(), n * sizeof(Vec3f)) == 0;
+        cout << left << setw(12) << edit << right << setw(12) << setprecision(4) << ms << setw(12) << numUpdated
+             << setw(9) << setprecision(1) << fullMs / ms << "x" << setw(10) << (same ? "yes" : "NO") << endl;
+    }
+    return 0;
+}
+
+static int benchTopology(const string& filename, int repeats) {
+    TriangleMesh mesh;
+    mesh.setUseMeshCache(false);
+    mesh.setBuildLods(false);
+    if (!loadMesh(mesh, filename)) return 1;
+    const vector<Vec3i>& triangles = mesh.getTriangles();
+    const std::size_t n = mesh.getNumVertices();
+
+    cout << filename << ": " << n << " vertices, " << triangles.size() << " triangles, best of "
+         << repeats << " runs" << endl;
+    MeshTopology topology;
+    cout << left << setw(12) << "threads" << right << setw(12) << "build ms" << endl;
+    for (unsigned int threads = 1;; threads = std::min(2 * threads, defaultThreadCount())) {
+        double ms = bestOf(repeats, [&] { topology.build(triangles.data(), triangles.size(), n, threads); });
+        cout << left << setw(12) << threads << right << fixed << setprecision(3) << setw(12) << ms << endl;
+        if (threads == defaultThreadCount()) break;
+    }
+    cout << "memory: " << topology.memoryBytes() << " bytes, " << setprecision(2)
+         << (double)topology.memoryBytes() / triangles.size() << " per triangle" << endl;
+    cout << "half edges: " << 3 * triangles.size() << ", border " << topology.getNumBorderEdges()
+         << ", non manifold " << topology.getNumNonManifoldEdges() << endl;
+
+    vector<uint32_t> ring;
+    std::size_t ringSizes = 0, borderVertices = 0;
+    double ringMs = bestOf(repeats, [&] {
+        ringSizes = 0;
+        borderVertices = 0;
+        for (std::size_t v = 0; v < n; v++) {
+            topology.oneRing(v, ring);
+            ringSizes += ring.size();
+            borderVertices += topology.isBorderVertex(v) ? 1 : 0;
+        }
+    });
+    cout << "one rings: " << setprecision(3) << ringMs << " ms, " << setprecision(2) << (double)ringSizes / n
+         << " neighbours per vertex, " << borderVertices << " border vertices" << endl;
+    return 0;
+}
+
+static int benchQuantize(const string& filename, int repeats, bool gl) {
+    TriangleMesh mesh;
+    mesh.setUseMeshCache(false);
+    mesh.setBuildLods(false);
+    if (!loadMesh(mesh, filename)) return 1;
+    const std::size_t n = mesh.getNumVertices();
+    std::size_t bytes = mesh.getVertexBytes();
+    double drawFull = gl ? bestOf(repeats, [&] { mesh.drawArray(); glFinish(); }) : 0.0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mesh.setQuantized(true);
+    double ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+    const QuantizationError& error = mesh.getQuantizationError();
+    float diagonal = (mesh.getBoundsMax() - mesh.getBoundsMin()).length();
+    std::size_t quantizedBytes = mesh.getVertexBytes();
+
+    cout << filename << ": " << n << " vertices, " << mesh.getTriangles().size() << " triangles" << endl;
+    cout << "vertex memory: " << bytes << " -> " << quantizedBytes << " bytes (" << fixed << setprecision(1)
+         << (bytes == 0 ? 0.0 : 100.0 - 100.0 * quantizedBytes / bytes) << "% less), converted in "
+         << setprecision(3) << ms << " ms" << endl;
+    cout << "max. error: position " << scientific << setprecision(2) << error.position << " ("
+         << (diagonal > 0.0f ? error.position / diagonal : 0.0f) << " of the diagonal), normal " << fixed
+         << setprecision(3) << error.normalDegrees << " degrees, texture coordinates " << scientific
+         << setprecision(2) << error.texCoord << endl;
+    if (gl) {
+        double drawQuantized = bestOf(repeats, [&] { mesh.drawArray(); glFinish(); });
+        cout << "draw: " << fixed << setprecision(3) << drawFull << " -> " << drawQuantized << " ms" << endl;
+    }
+    return 0;
+}
+
+// a gluLookAt and gluPerspective view at a 1080 x 1080 viewport
+static ViewState lookAtView(const Vec3f& eye, const Vec3f& target, float fovY, float zNear, float zFar) {
+    ViewState view;
+    Vec3f f = (target - eye).normalized();
+    Vec3f up = fabsf(f.y) > 0.99f ? Vec3f(1.0f, 0.0f, 0.0f) : Vec3f(0.0f, 1.0f, 0.0f);
+    Vec3f side = (f ^ up).normalized();
+    Vec3f u = side ^ f;
+    GLfloat* m = view.modelview;
+    for (int i = 0; i < 3; i++) {
+        m[4 * i] = side[i];
+        m[4 * i + 1] = u[i];
+        m[4 * i + 2] = -f[i];
+        m[4 * i + 3] = 0.0f;
+    }
+    m[12] = -(side * eye);
+    m[13] = -(u * eye);
+    m[14] = f * eye;
+    m[15] = 1.0f;
+    GLfloat* p = view.projection;
+    for (int i = 0; i < 16; i++) p[i] = 0.0f;
+    float focal = 1.0f / tanf(fovY * 0.5f);
+    p[0] = focal;
+    p[5] = focal;
+    p[10] = (zFar + zNear) / (zNear - zFar);
+    p[11] = -1.0f;
+    p[14] = 2.0f * zFar * zNear / (zNear - zFar);
+    view.viewport[0] = view.viewport[1] = 0;
+    view.viewport[2] = view.viewport[3] = 1080;
+    return view;
+}
+
+static int benchMeshlets(const string& filename, int views) {
+    TriangleMesh mesh;
+    mesh.setUseMeshCache(false);
+    mesh.setBuildLods(false);
+    mesh.setBuildMeshlets(false);
+    if (!loadMesh(mesh, filename)) return 1;
+    double buildMs = bestOf(1, [&] { mesh.buildMeshlets(); });
+    const vector<Meshlet>& meshlets = mesh.getMeshlets();
+    const vector<Vec3i>& triangles = mesh.getTriangles();
+    const vector<Vec3f>& positions = mesh.getPoints();
+    std::size_t withCone = 0, meshletVertices = 0;
+    vector<uint32_t> stamp(positions.size(), 0);
+    for (std::size_t i = 0; i < meshlets.size(); i++) {
+        withCone += meshlets[i].coneAxis != Vec3f() ? 1 : 0;
+        for (uint32_t t = meshlets[i].firstTriangle; t < meshlets[i].firstTriangle + meshlets[i].numTriangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                if (stamp[triangles[t][k]] == i + 1) continue;
+                stamp[triangles[t][k]] = (uint32_t)i + 1;
+                meshletVertices++;
+            }
+        }
+    }
+    cout << filename << ": " << triangles.size() << " triangles in " << meshlets.size() << " meshlets ("
+         << fixed << setprecision(1) << (double)triangles.size() / meshlets.size() << " triangles, "
+         << (double)meshletVertices / meshlets.size() << " vertices each, " << withCone << " with a cone), built in "
+         << setprecision(3) << buildMs << " ms" << endl;
+
+    Vec3f center = (mesh.getBoundsMin() + mesh.getBoundsMax()) * 0.5f;
+    float diagonal = (mesh.getBoundsMax() - mesh.getBoundsMin()).length();
+    const float fovY = 60.0f * (float)M_PI / 180.0f;
+    cout << left << setw(8) << "camera" << right << setw(10) << "outside" << setw(12) << "backfacing" << setw(10)
+         << "drawn" << setw(18) << "back facing tris" << setw(12) << "cull us" << endl;
+    const char* names[] = { "far", "near" };
+    const float distances[] = { 0.5f * diagonal / sinf(fovY * 0.5f), 0.4f * diagonal };
+    for (int d = 0; d < 2; d++) {
+        double outside = 0.0, backfacing = 0.0, drawn = 0.0, backTriangles = 0.0, cullUs = 0.0;
+        vector<uint32_t> visible;
+        for (int i = 0; i < views; i++) {
+            // golden angle spiral, evenly spread over the sphere
+            float z = 1.0f - (2.0f * i + 1.0f) / views;
+            float r = sqrtf(1.0f - z * z);
+            float phi = 2.39996323f * i;
+            Vec3f eye = center + Vec3f(r * cosf(phi), z, r * sinf(phi)) * distances[d];
+            ViewState view = lookAtView(eye, center, fovY, 0.001f * diagonal, 10.0f * diagonal);
+            Frustum frustum(view);
+            MeshletCulling culling;
+            cullUs += 1000.0 * bestOf(3, [&] {
+                visible.clear();
+                culling = cullMeshlets(meshlets, view, frustum, visible);
+            });
+            std::size_t outsideTriangles = 0, backfacingTriangles = 0;
+            float planes[6][4];
+            view.frustumPlanes(planes);
+            for (const Meshlet& m : meshlets) {
+                bool inside = true;
+                for (int p = 0; p < 6 && inside; p++) {
+                    inside = planes[p][0] * m.center.x + planes[p][1] * m.center.y + planes[p][2] * m.center.z +
+                             planes[p][3] >= -m.radius;
+                }
+                if (!inside) outsideTriangles += m.numTriangles;
+            }
+            backfacingTriangles = triangles.size() - outsideTriangles - culling.visibleTriangles;
+            std::size_t facingAway = 0;
+            for (const Vec3i& t : triangles) {
+                const Vec3f& p0 = positions[t[0]];
+                facingAway += ((p0 - positions[t[1]]) ^ (p0 - positions[t[2]])) * (p0 - eye) > 0.0f ? 1 : 0;
+            }
+            outside += (double)outsideTriangles / triangles.size();
+            backfacing += (double)backfacingTriangles / triangles.size();
+            drawn += (double)culling.visibleTriangles / triangles.size();
+            backTriangles += (double)facingAway / triangles.size();
+        }
+        cout << left << setw(8) << names[d] << right << setprecision(1) << setw(9) << 100.0 * outside / views << "%"
+             << setw(11) << 100.0 * backfacing / views << "%" << setw(9) << 100.0 * drawn / views << "%" << setw(17)
+             << 100.0 * backTriangles / views << "%" << setw(12) << setprecision(2) << cullUs / views << endl;
+    }
+    return 0;
+}
+
+static int benchCulling(const string& filename, int copies, int views) {
+    TriangleMesh mesh;
+    if (!loadMesh(mesh, filename)) return 1;
+    // copies on a square grid, one bounding sphere diameter apart
+    float spacing = 2.0f * mesh.getBoundsRadius();
+    int side = (int)ceilf(sqrtf((float)copies));
+    vector<Vec3f> offsets(copies);
+    for (int i = 0; i < copies; i++) offsets[i] = Vec3f((i % side) * spacing, 0.0f, (i / side) * spacing);
+    float extent = side * spacing;
+    const float fovY = 60.0f * (float)M_PI / 180.0f;
+    cout << filename << ": " << copies << " copies on a " << side << " x " << side << " grid, " << views
+         << " views from inside" << endl;
+
+    double visible = 0.0, culled = 0.0, testNs = 0.0;
+    std::size_t seed = 1;
+    auto random = [&] {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (float)((seed >> 33) & 0xffffff) / (float)0x1000000;
+    };
+    for (int i = 0; i < views; i++) {
+        // walking through the grid at the height of the meshes
+        Vec3f eye(random() * extent, mesh.getBoundsCenter().y, random() * extent);
+        float angle = 2.0f * (float)M_PI * random();
+        Frustum frustum(lookAtView(eye, eye + Vec3f(cosf(angle), 0.0f, sinf(angle)), fovY, 0.01f * spacing, extent));
+        std::size_t inside = 0;
+        testNs += 1e6 * bestOf(3, [&] {
+            inside = 0;
+            for (const Vec3f& offset : offsets) {
+                // the frustum MeshObject::draw hands to each mesh, moved by its position
+                if (mesh.inFrustum(frustum.translated(offset))) inside++;
+            }
+        }) / copies;
+        visible += inside;
+        culled += copies - inside;
+    }
+    cout << fixed << setprecision(1) << "visible " << 100.0 * visible / (visible + culled) << "%, culled "
+         << 100.0 * culled / (visible + culled) << "%, " << setprecision(1) << testNs / views
+         << " ns per mesh test" << endl;
+    return 0;
+}
+
+static int benchBvh(int objects, int views, unsigned int threads) {
+    // unit boxes of random size scattered over a square city of side
+    // extent at a density of one object per 100 square units
+    float extent = 10.0f * sqrtf((float)objects);
+    std::size_t seed = 1;
+    auto random = [&] {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (float)((seed >> 33) & 0xffffff) / (float)0x1000000;
+    };
+    vector<Vec3f> mins(objects), maxs(objects);
+    for (int i = 0; i < objects; i++) {
+        Vec3f size(1.0f + 3.0f * random(), 1.0f + 9.0f * random(), 1.0f + 3.0f * random());
+        mins[i] = Vec3f(random() * extent, 0.0f, random() * extent);
+        maxs[i] = mins[i] + size;
+    }
+    DynamicBvh bvh;
+    vector<int> leaves(objects);
+    double buildMs = bestOf(1, [&] {
+        for (int i = 0; i < objects; i++) leaves[i] = bvh.insert(mins[i], maxs[i], (uint32_t)i);
+    });
+    cout << objects << " objects: inserted in " << fixed << setprecision(2) << buildMs << " ms, height "
+         << bvh.getHeight() << ", cost " << setprecision(1) << bvh.getCost() << endl;
+
+    // walking through the city, looking along the ground
+    const float fovY = 60.0f * (float)M_PI / 180.0f;
+    double flatMs = 0.0, oneMs = 0.0, threadsMs = 0.0, visible = 0.0;
+    vector<uint32_t> found, foundThreads;
+    bool same = true;
+    for (int v = 0; v < views; v++) {
+        Vec3f eye(random() * extent, 2.0f, random() * extent);
+        float angle = 2.0f * (float)M_PI * random();
+        ViewState view = lookAtView(eye, eye + Vec3f(cosf(angle), 0.0f, sinf(angle)), fovY, 0.1f, 0.25f * extent);
+        Frustum frustum(view);
+        std::size_t inside = 0;
+        flatMs += bestOf(3, [&] {
+            inside = 0;
+            for (int i = 0; i < objects; i++) inside += frustum.boxVisible(mins[i], maxs[i]);
+        });
+        oneMs += bestOf(3, [&] {
+            found.clear();
+            bvh.cull(frustum, found);
+        });
+        threadsMs += bestOf(3, [&] {
+            foundThreads.clear();
+            bvh.cull(frustum, foundThreads, threads);
+        });
+        same = same && found == foundThreads && found.size() == inside;
+        visible += found.size();
+    }
+    cout << "visible " << setprecision(1) << 100.0 * visible / ((double)views * objects) << "%, culling ms: flat "
+         << setprecision(3) << flatMs / views << ", hierarchy " << oneMs / views << ", " << threads << " threads "
+         << threadsMs / views << (same ? "" : " (results differ)") << endl;
+
+    // moving a tenth of the objects a little, then moving them far and back
+    // in again
+    std::size_t moved = std::max(1, objects / 10);
+    double refitMs = bestOf(1, [&] {
+        for (std::size_t i = 0; i < moved; i++) {
+            Vec3f step(random() - 0.5f, 0.0f, random() - 0.5f);
+            mins[i] += step;
+            maxs[i] += step;
+            bvh.refit(leaves[i], mins[i], maxs[i]);
+        }
+    });
+    double reinsertMs = bestOf(1, [&] {
+        for (std::size_t i = 0; i < moved; i++) {
+            Vec3f size = maxs[i] - mins[i];
+            mins[i] = Vec3f(random() * extent, 0.0f, random() * extent);
+            maxs[i] = mins[i] + size;
+            bvh.remove(leaves[i]);
+            leaves[i] = bvh.insert(mins[i], maxs[i], (uint32_t)i);
+        }
+    });
+    cout << moved << " objects: refit in " << setprecision(2) << refitMs << " ms, removed and inserted in "
+         << reinsertMs << " ms, cost " << setprecision(1) << bvh.getCost() << endl;
+    return 0;
+}
+
+static int benchDraw(const string& filename, int repeats) {
+    TriangleMesh mesh;
+    if (!loadMesh(mesh, filename)) return 1;
+    mesh.setLodThreshold(0.0f);
+    Vec3f center = (mesh.getBoundsMin() + mesh.getBoundsMax()) * 0.5f;
+    float radius = (mesh.getBoundsMax() - mesh.getBoundsMin()).length() * 0.5f;
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(60.0, 1.0, 0.01 * radius, 10.0 * radius);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(0.0f, 0.0f, -2.0f * radius);
+    glRotatef(30.0f, 1.0f, 1.0f, 0.0f);
+    glTranslatef(-center.x, -center.y, -center.z);
+    GLfloat light[] = { -radius, radius, 2.0f * radius, 1.0f };
+    glLightfv(GL_LIGHT0, GL_POSITION, light);
+    glEnable(GL_LIGHTING);
+    glColor3f(1.0f, 1.0f, 1.0f);
+
+    cout << filename << ": " << mesh.getTriangles().size() << " triangles, best of " << repeats << " runs" << endl;
+    cout << left << setw(16) << "mode" << right << setw(12) << "draw ms" << setw(12) << "frame ms" << setw(10)
+         << "issued" << setw(10) << "skipped" << endl;
+    const char* names[] = { "immediate", "vertex arrays", "buffer objects", "shaders" };
+    for (unsigned int mode = 0; mode < 4; mode++) {
+        mesh.setDrawMode(mode);
+        // uploads the buffers and builds the shaders
+        mesh.draw();
+        glFinish();
+        // GL state changes of one draw after another one in the same mode
+        GLStateCache& state = GLStateCache::instance();
+        state.beginFrame();
+        mesh.draw();
+        state.beginFrame();
+        GLStateCache::Counts changes = state.lastFrame();
+        double draw = bestOf(repeats, [&] { mesh.draw(); });
+        glFinish();
+        double frame = bestOf(repeats, [&] {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            mesh.draw();
+            glFinish();
+        });
+        cout << left << setw(16) << names[mode] << right << fixed << setprecision(3) << setw(12) << draw
+             << setw(12) << frame << setw(10) << changes.issued << setw(10) << changes.skipped << endl;
+    }
+    return 0;
+}
+
+static void usage() {
+    cout << "usage: meshbench layout <mesh file> [repeats] [--gl]" << endl;
+    cout << "       meshbench overdraw <mesh file> [views] [resolution]" << endl;
+    cout << "       meshbench lod <mesh file> [threshold]" << endl;
+    cout << "       meshbench normals <mesh file> [repeats]" << endl;
+    cout << "       meshbench topology <mesh file> [repeats]" << endl;
+    cout << "       meshbench quantize <mesh file> [repeats] [--gl]" << endl;
+    cout << "       meshbench meshlets <mesh file> [views]" << endl;
+    cout << "       meshbench draw <mesh file> [repeats]" << endl;
+    cout << "       meshbench culling <mesh file> [copies] [views]" << endl;
+    cout << "       meshbench bvh <objects> [views] [threads]" << endl;
+}
+
+int main(int argc, char** argv) {
+    bool gl = false;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gl") == 0) gl = true;
+        else args.push_back(argv[i]);
+    }
+    if (args.size() < 2) {
+        usage();
+        return 1;
+    }
+    // draw always needs the window
+    if (args[0] == "draw") gl = true;
+    if (gl) {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
+        glutCreateWindow("meshbench");
+        if (glewInit() != GLEW_OK) {
+            cout << "meshbench: glewInit failed" << endl;
+            return 1;
+        }
+    }
+    if (args[0] == "layout") {
+        int repeats = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 5;
+        return benchLayout(args[1], repeats, gl);
+    }
+    if (args[0] == "overdraw") {
+        int views = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 32;
+        int resolution = args.size() > 3 ? std::max(16, atoi(args[3].c_str())) : 256;
+        return benchOverdraw(args[1], views, resolution);
+    }
+    if (args[0] == "topology") {
+        int repeats = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 5;
+        return benchTopology(args[1], repeats);
+    }
+    if (args[0] == "normals") {
+        int repeats = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 5;
+        return benchNormals(args[1], repeats);
+    }
+    if (args[0] == "quantize") {
+        int repeats = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 5;
+        return benchQuantize(args[1], repeats, gl);
+    }
+    if (args[0] == "meshlets") {
+        int views = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 64;
+        return benchMeshlets(args[1], views);
+    }
+    if (args[0] == "draw") {
+        int repeats = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 20;
+        return benchDraw(args[1], repeats);
+    }
+    if (args[0] == "culling") {
+        int copies = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 1000;
+        int views = args.size() > 3 ? std::max(1, atoi(args[3].c_str())) : 64;
+        return benchCulling(args[1], copies, views);
+    }
+    if (args[0] == "bvh") {
+        int views = args.size() > 2 ? std::max(1, atoi(args[2].c_str())) : 64;
+        unsigned int threads = args.size() > 3 ? (unsigned int)std::max(1, atoi(args[3].c_str())) : defaultThreadCount();
+        return benchBvh(std::max(1, atoi(args[1].c_str())), views, threads);
+    }
+    if (args[0] == "lod") {
+        float threshold = args.size() > 2 ? (float)atof(args[2].c_str()) : 1.0f;
+        return benchLod(args[1], threshold > 0.0f ? threshold : 1.0f);
+    }
+    usage();
+    return 1;
+}
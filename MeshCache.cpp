@@ -0,0 +1,186 @@
+#include "MeshCache.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+static const char cacheMagic[8] = { 'T', 'M', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+string MeshCache::pathFor(const char* source) {
+    return string(source) + ".tmc";
+}
+
+bool MeshCache::stamp(const char* filename, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    std::filesystem::path path(filename);
+    size = (uint64_t)std::filesystem::file_size(path, error);
+    if (error) return false;
+    time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+bool MeshCache::hashFile(const char* filename, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    hash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+// checks that count elements of size bytes at offset lie inside the file
+static bool validSection(const MappedFile& file, uint64_t offset, uint64_t count, std::size_t size) {
+    if (offset % MeshCacheHeader::ALIGNMENT != 0 || offset > file.size()) return false;
+    return count <= (file.size() - offset) / size;
+}
+
+// checks that all corners of count triangles index one of numVertices vertices
+static bool validIndices(const Vec3i* triangles, uint64_t count, uint64_t numVertices) {
+    for (uint64_t i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) {
+            if ((uint64_t)(uint32_t)triangles[i][k] >= numVertices) return false;
+        }
+    }
+    return true;
+}
+
+bool MeshCache::read(const char* source, uint32_t flags, MappedFile& file, MeshCacheData& data) {
+    uint64_t size;
+    int64_t time;
+    if (!stamp(source, size, time)) return false;
+    string path = pathFor(source);
+    if (!file.open(path.c_str())) return false;
+    if (file.size() < sizeof(MeshCacheHeader)) return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0) return false;
+    if (header.version != MeshCacheHeader::VERSION || header.flags != flags) return false;
+    if (header.sourceSize != size) return false;
+    if (header.sourceTime != time) {
+        // touched or copied, but maybe not changed
+        uint64_t hash;
+        if (!hashFile(source, hash) || hash != header.sourceHash) return false;
+        // remember the new time so the next load skips the hash again
+        header.sourceTime = time;
+        FILE* out = fopen(path.c_str(), "r+b");
+        if (out) {
+            fwrite(&header, sizeof(header), 1, out);
+            fclose(out);
+        }
+    }
+    if (!validSection(file, header.verticesOffset, header.numVertices, sizeof(Vec3f)) ||
+        !validSection(file, header.normalsOffset, header.numNormals, sizeof(Vec3f)) ||
+        !validSection(file, header.texturesOffset, header.numTextures, sizeof(TriangleMesh::Tex2D)) ||
+        !validSection(file, header.trianglesOffset, header.numTriangles, sizeof(Vec3i))) {
+        return false;
+    }
+    if (header.numLods > MeshCacheHeader::MAX_LODS) return false;
+    uint64_t numLodTriangles = 0;
+    for (uint32_t i = 0; i < header.numLods; i++) numLodTriangles += header.lodTriangles[i];
+    if (!validSection(file, header.lodTrianglesOffset, numLodTriangles, sizeof(Vec3i))) return false;
+    if (!validSection(file, header.meshletsOffset, header.numMeshlets, sizeof(Meshlet))) return false;
+    // a damaged file can have a valid header, the loader would index out of range
+    if (!validIndices((const Vec3i*)(file.data() + header.trianglesOffset), header.numTriangles, header.numVertices) ||
+        !validIndices((const Vec3i*)(file.data() + header.lodTrianglesOffset), numLodTriangles, header.numVertices)) {
+        return false;
+    }
+    // meshlets have to cover the triangles in order
+    const Meshlet* meshlets = (const Meshlet*)(file.data() + header.meshletsOffset);
+    uint64_t meshletTriangles = 0;
+    for (uint64_t i = 0; i < header.numMeshlets; i++) {
+        if (meshlets[i].firstTriangle != meshletTriangles) return false;
+        meshletTriangles += meshlets[i].numTriangles;
+    }
+    if (header.numMeshlets > 0 && meshletTriangles != header.numTriangles) return false;
+
+    data.vertices = (const Vec3f*)(file.data() + header.verticesOffset);
+    data.normals = (const Vec3f*)(file.data() + header.normalsOffset);
+    data.textures = (const TriangleMesh::Tex2D*)(file.data() + header.texturesOffset);
+    data.triangles = (const Vec3i*)(file.data() + header.trianglesOffset);
+    data.numVertices = (std::size_t)header.numVertices;
+    data.numNormals = (std::size_t)header.numNormals;
+    data.numTextures = (std::size_t)header.numTextures;
+    data.numTriangles = (std::size_t)header.numTriangles;
+    data.boundsMin.set(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    data.boundsMax.set(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    data.lodTriangles = (const Vec3i*)(file.data() + header.lodTrianglesOffset);
+    data.numLods = header.numLods;
+    for (uint32_t i = 0; i < header.numLods; i++) {
+        data.lodTriangleCounts[i] = header.lodTriangles[i];
+        data.lodErrors[i] = header.lodErrors[i];
+    }
+    data.meshlets = meshlets;
+    data.numMeshlets = (std::size_t)header.numMeshlets;
+    return true;
+}
+
+// offset of the next section behind size bytes at offset
+static uint64_t nextSection(uint64_t offset, uint64_t size) {
+    uint64_t end = offset + size;
+    return (end + MeshCacheHeader::ALIGNMENT - 1) / MeshCacheHeader::ALIGNMENT * MeshCacheHeader::ALIGNMENT;
+}
+
+// writes size bytes and pads with zeros up to offset
+static bool writePadded(FILE* out, const void* data, uint64_t size, uint64_t position, uint64_t offset) {
+    static const char zeros[MeshCacheHeader::ALIGNMENT] = {};
+    if (size > 0 && fwrite(data, 1, (std::size_t)size, out) != size) return false;
+    uint64_t padding = offset - (position + size);
+    return padding == 0 || fwrite(zeros, 1, (std::size_t)padding, out) == padding;
+}
+
+bool MeshCache::write(const char* source, uint32_t flags, const MeshCacheData& data) {
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = MeshCacheHeader::VERSION;
+    header.flags = flags;
+    if (!stamp(source, header.sourceSize, header.sourceTime)) return false;
+    if (!hashFile(source, header.sourceHash)) return false;
+    header.numVertices = data.numVertices;
+    header.numNormals = data.numNormals;
+    header.numTextures = data.numTextures;
+    header.numTriangles = data.numTriangles;
+    header.verticesOffset = nextSection(0, sizeof(header));
+    header.normalsOffset = nextSection(header.verticesOffset, data.numVertices * sizeof(Vec3f));
+    header.texturesOffset = nextSection(header.normalsOffset, data.numNormals * sizeof(Vec3f));
+    header.trianglesOffset = nextSection(header.texturesOffset, data.numTextures * sizeof(TriangleMesh::Tex2D));
+    header.lodTrianglesOffset = nextSection(header.trianglesOffset, data.numTriangles * sizeof(Vec3i));
+    header.numLods = (uint32_t)std::min<std::size_t>(data.numLods, MeshCacheHeader::MAX_LODS);
+    uint64_t numLodTriangles = 0;
+    for (uint32_t i = 0; i < header.numLods; i++) {
+        header.lodTriangles[i] = (uint32_t)data.lodTriangleCounts[i];
+        header.lodErrors[i] = data.lodErrors[i];
+        numLodTriangles += data.lodTriangleCounts[i];
+    }
+    header.meshletsOffset = nextSection(header.lodTrianglesOffset, numLodTriangles * sizeof(Vec3i));
+    header.numMeshlets = data.numMeshlets;
+    uint64_t fileSize = nextSection(header.meshletsOffset, data.numMeshlets * sizeof(Meshlet));
+    for (int i = 0; i < 3; i++) {
+        header.boundsMin[i] = data.boundsMin[i];
+        header.boundsMax[i] = data.boundsMax[i];
+    }
+
+    // write to a temporary file first, a crash must not leave a broken cache behind
+    string path = pathFor(source);
+    string temporary = path + ".tmp";
+    FILE* out = fopen(temporary.c_str(), "wb");
+    if (!out) return false;
+    bool ok = writePadded(out, &header, sizeof(header), 0, header.verticesOffset) &&
+        writePadded(out, data.vertices, data.numVertices * sizeof(Vec3f), header.verticesOffset, header.normalsOffset) &&
+        writePadded(out, data.normals, data.numNormals * sizeof(Vec3f), header.normalsOffset, header.texturesOffset) &&
+        writePadded(out, data.textures, data.numTextures * sizeof(TriangleMesh::Tex2D), header.texturesOffset, header.trianglesOffset) &&
+        writePadded(out, data.triangles, data.numTriangles * sizeof(Vec3i), header.trianglesOffset, header.lodTrianglesOffset) &&
+        writePadded(out, data.lodTriangles, numLodTriangles * sizeof(Vec3i), header.lodTrianglesOffset, header.meshletsOffset) &&
+        writePadded(out, data.meshlets, data.numMeshlets * sizeof(Meshlet), header.meshletsOffset, fileSize);
+    ok = (fclose(out) == 0) && ok;
+    if (ok) {
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        ok = !error;
+    }
+    if (!ok) {
+        remove(temporary.c_str());
+        cout << "MeshCache: can not write " << path << endl;
+    }
+    return ok;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// Versioned binary sidecar (<source>.tmc) holding a fully processed mesh.
+// All arrays are stored raw and 64 byte aligned, so a mapped cache file can
+// be copied into the mesh arrays without any parsing. A cache is only used
+// if it was written for the same source size and modification time, or, if
+// those changed, for the same source content.
+
+#include <cstdint>
+#include <string>
+#include "Vec3.h"
+#include "TriangleMesh.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+struct MeshCacheHeader {
+    enum { VERSION = 3, ALIGNMENT = 64, MAX_LODS = 8 };
+    char magic[8];
+    uint32_t version;
+    // load options the data was created with (see TriangleMesh::cacheFlags)
+    uint32_t flags;
+    // key of the source file
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    // arrays: element counts and byte offsets from the start of the file
+    uint64_t numVertices, numNormals, numTextures, numTriangles;
+    uint64_t verticesOffset, normalsOffset, texturesOffset, trianglesOffset;
+    float boundsMin[3], boundsMax[3];
+    // levels of detail: their triangles one after the other in one section
+    uint32_t numLods;
+    uint32_t lodTriangles[MAX_LODS];
+    float lodErrors[MAX_LODS];
+    uint64_t lodTrianglesOffset;
+    // Meshlet records, their triangles are ranges of the triangle section
+    uint64_t numMeshlets;
+    uint64_t meshletsOffset;
+};
+
+// views into a mapped cache file
+struct MeshCacheData {
+    const Vec3f* vertices;
+    const Vec3f* normals;
+    const TriangleMesh::Tex2D* textures;
+    const Vec3i* triangles;
+    std::size_t numVertices, numNormals, numTextures, numTriangles;
+    Vec3f boundsMin, boundsMax;
+    // triangles of all levels of detail, lodTriangles[i] of them belong to level i
+    const Vec3i* lodTriangles;
+    std::size_t numLods;
+    std::size_t lodTriangleCounts[MeshCacheHeader::MAX_LODS];
+    float lodErrors[MeshCacheHeader::MAX_LODS];
+    const Meshlet* meshlets;
+    std::size_t numMeshlets;
+};
+
+class MeshCache
+{
+public:
+    // file name of the cache belonging to source
+    static string pathFor(const char* source);
+
+    // maps the cache of source into file and fills data if it is up to date
+    // and was written with the same flags
+    static bool read(const char* source, uint32_t flags, MappedFile& file, MeshCacheData& data);
+
+    // writes the cache of source. returns false on I/O errors
+    static bool write(const char* source, uint32_t flags, const MeshCacheData& data);
+
+private:
+    // size and modification time of a file
+    static bool stamp(const char* filename, uint64_t& size, int64_t& time);
+    // hash of the whole file content
+    static bool hashFile(const char* filename, uint64_t& hash);
+};
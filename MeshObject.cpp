@@ -1,5 +1,8 @@
 #include "MeshObject.h"
+#include "GLStateCache.h"
+#include <algorithm>
 #include <vector>
+#include <iostream>
 
 
 MeshObject::MeshObject()
@@ -25,12 +28,14 @@ void MeshObject::addTriangleMesh(TriangleMesh* Mesh)
 {
 }
 
-void MeshObject::loadAddTriangleMesh(const char* filename)
+void MeshObject::loadAddTriangleMesh(const char* filename, const char* texture)
 {
 	TriangleMesh a = TriangleMesh();
-	a.loadOBJ(filename);
-	char* texture = "Modelle/textures/Medieval tower_mid_Col.jpg";
-	a.loadTexture(texture);
+	// a streamed load builds its levels of detail on the stream thread
+	a.setBuildLods(true);
+	a.loadStreaming(filename);
+	// textures are shared, loading the same one for several meshes is cheap
+	if (texture) a.loadTexture(texture);
 	triangleMeshes.push_back(a);
 	//triangleMeshes[triangleMeshes.size() - 1].loadOBJ(filename);
 }
@@ -44,16 +49,83 @@ void MeshObject::load_tex(const char* filename)
 {
 }
 
-void MeshObject::draw()
+void MeshObject::draw(bool resetBindings)
 {
+	draw(ViewState::current(), resetBindings);
+}
+
+void MeshObject::draw(const ViewState& view, bool resetBindings)
+{
+	// one frustum for all meshes, each moves it by its position
+	ViewState objectView = view.translated(position);
+	Frustum frustum(objectView);
 	glPushMatrix();
 	glTranslatef(position.x, position.y, position.z);
+	culling = FrustumCulling();
 	for (TriangleMesh& t : triangleMeshes) {
-		t.draw();
+		if (t.draw(objectView, frustum)) culling.visible++;
+		else culling.culled++;
 	}
+	// the meshes leave their state for the next one, not for the rest of the frame
+	if (resetBindings) GLStateCache::instance().resetBindings();
 	glPopMatrix();
 }
 
+const FrustumCulling& MeshObject::getCulling() const
+{
+	return culling;
+}
+
+bool MeshObject::isLoading() const
+{
+	for (const TriangleMesh& t : triangleMeshes) {
+		if (t.isLoading()) return true;
+	}
+	return false;
+}
+
+bool MeshObject::getBounds(Vec3f& min, Vec3f& max) const
+{
+	if (triangleMeshes.empty() || isLoading()) return false;
+	for (std::size_t i = 0; i < triangleMeshes.size(); i++) {
+		const TriangleMesh& t = triangleMeshes[i];
+		Vec3f offset = position + t.getPosition();
+		Vec3f meshMin = t.getBoundsMin() + offset, meshMax = t.getBoundsMax() + offset;
+		for (int k = 0; k < 3; k++) {
+			min[k] = i == 0 ? meshMin[k] : std::min(min[k], meshMin[k]);
+			max[k] = i == 0 ? meshMax[k] : std::max(max[k], meshMax[k]);
+		}
+	}
+	return true;
+}
+
+void MeshObject::switchVertexLayout()
+{
+	for (TriangleMesh& t : triangleMeshes) {
+		t.setInterleaved(!t.isInterleaved());
+	}
+	if (!triangleMeshes.empty()) {
+		cout << "vertex layout switched to " << (triangleMeshes[0].isInterleaved() ? "interleaved" : "separate") << endl;
+	}
+}
+
+void MeshObject::switchQuantized()
+{
+	for (TriangleMesh& t : triangleMeshes) {
+		t.setQuantized(!t.isQuantized());
+	}
+	if (!triangleMeshes.empty()) {
+		cout << "vertices " << (triangleMeshes[0].isQuantized() ? "quantized" : "full precision") << endl;
+	}
+}
+
+void MeshObject::switchDrawMode()
+{
+	for (TriangleMesh& t : triangleMeshes) {
+		t.switchDrawMode();
+	}
+}
+
 void MeshObject::setPosition(float x, float y, float z)
 {
 	position.x = x;
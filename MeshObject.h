@@ -2,8 +2,10 @@
 
 #include <vector>
 #include <Vec3.h>
+#include <GL/glew.h>
 #include <GL/glut.h>
 #include "TriangleMesh.h"
+#include "Frustum.h"
 
 using namespace std;
 
@@ -15,16 +17,35 @@ public:
 	~MeshObject();
 
 	void addTriangleMesh(TriangleMesh* Mesh);
-	void loadAddTriangleMesh(const char* filename);
+	// streams in the mesh of filename and gives it the texture (if not null)
+	void loadAddTriangleMesh(const char* filename, const char* texture = nullptr);
 	void load(const char* filename);
 	void load_tex(const char* filename);
 
-	void draw();
+	// draws the meshes inside the view frustum. resetBindings false leaves
+	// the GL state to the next object (see GLStateCache::resetBindings)
+	void draw(bool resetBindings = true);
+	// draw with view, the GL view at the call, which the caller computed once per frame
+	void draw(const ViewState& view, bool resetBindings = true);
+	// meshes drawn and culled by the last draw
+	const FrustumCulling& getCulling() const;
+	// true while a mesh is still streamed in
+	bool isLoading() const;
+	// box around the meshes, with the positions of object and meshes. false
+	// while there is none: no meshes or one still streamed in
+	bool getBounds(Vec3f& min, Vec3f& max) const;
+	// toggles all meshes between separate and interleaved vertex arrays
+	void switchVertexLayout();
+	// toggles all meshes between full precision and quantized vertices
+	void switchQuantized();
+	// cycles all meshes through immediate mode, vertex arrays and buffer objects
+	void switchDrawMode();
 	void setPosition(float x, float y, float z);
 
 private:
 	vector<TriangleMesh> triangleMeshes;
 	Vec3f position;
+	FrustumCulling culling;
 
 };
 
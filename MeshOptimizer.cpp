@@ -0,0 +1,403 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// FIFO vertex cache of 16 entries like the one analyzeVertexCache simulates,
+// which can be emptied
+struct FifoCache {
+    explicit FifoCache(std::size_t numVertices)
+        : entered(numVertices, 0), time(0), flushed(0) {
+    }
+    // returns true for a miss
+    bool access(int v) {
+        if (entered[v] > flushed && time - entered[v] < 16) return false;
+        entered[v] = ++time;
+        return true;
+    }
+    void flush() {
+        flushed = time;
+    }
+
+    vector<std::size_t> entered;
+    std::size_t time, flushed;
+};
+
+VertexCacheStats analyzeVertexCache(const vector<Vec3i>& triangles, std::size_t numVertices,
+                                    unsigned int cacheSize) {
+    // time stamp of each vertex' entry into the cache, a vertex is cached if
+    // fewer than cacheSize vertices entered after it
+    vector<std::size_t> entered(numVertices, 0);
+    vector<bool> used(numVertices, false);
+    std::size_t misses = 0, referenced = 0;
+    for (const Vec3i& t : triangles) {
+        for (int k = 0; k < 3; k++) {
+            int v = t[k];
+            if (!used[v]) {
+                used[v] = true;
+                referenced++;
+            }
+            else if (misses - entered[v] < cacheSize) continue;
+            // stamps start at 1 so that 0 never looks cached
+            misses++;
+            entered[v] = misses;
+        }
+    }
+    VertexCacheStats stats;
+    stats.acmr = triangles.empty() ? 0.0 : (double)misses / triangles.size();
+    stats.atvr = referenced == 0 ? 0.0 : (double)misses / referenced;
+    return stats;
+}
+
+// parameters from Forsyth's article
+static const int cacheSize = 32;
+static const int maxValence = 32;
+static const float cacheDecayPower = 1.5f;
+static const float lastTriangleScore = 0.75f;
+static const float valenceBoostScale = 2.0f;
+static const float valenceBoostPower = 0.5f;
+
+struct ForsythTables {
+    // score by position in the cache and by number of remaining triangles
+    float cache[cacheSize];
+    float valence[maxValence + 1];
+
+    ForsythTables() {
+        for (int i = 0; i < cacheSize; i++) {
+            // the three vertices of the last triangle score the same, so
+            // there is no preference for which edge to continue at
+            if (i < 3) cache[i] = lastTriangleScore;
+            else cache[i] = powf(1.0f - (float)(i - 3) / (cacheSize - 3), cacheDecayPower);
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i <= maxValence; i++) {
+            valence[i] = valenceBoostScale * powf((float)i, -valenceBoostPower);
+        }
+    }
+};
+
+static float vertexScore(const ForsythTables& tables, int cachePosition, int remaining) {
+    // no triangles left: the vertex does not matter anymore
+    if (remaining == 0) return -1.0f;
+    float score = cachePosition < 0 ? 0.0f : tables.cache[cachePosition];
+    return score + tables.valence[std::min(remaining, maxValence)];
+}
+
+void optimizeVertexCache(vector<Vec3i>& triangles, std::size_t numVertices) {
+    static const ForsythTables tables;
+    const std::size_t numTriangles = triangles.size();
+    if (numTriangles == 0) return;
+
+    // triangles of each vertex (CSR). the first remaining[v] entries of
+    // vertex v are the triangles not emitted yet
+    vector<int> remaining(numVertices, 0);
+    for (const Vec3i& t : triangles) {
+        for (int k = 0; k < 3; k++) remaining[t[k]]++;
+    }
+    vector<std::size_t> first(numVertices + 1, 0);
+    for (std::size_t v = 0; v < numVertices; v++) first[v + 1] = first[v] + remaining[v];
+    vector<int> adjacency(first[numVertices]);
+    {
+        vector<std::size_t> fill(first.begin(), first.end() - 1);
+        for (std::size_t i = 0; i < numTriangles; i++) {
+            for (int k = 0; k < 3; k++) adjacency[fill[triangles[i][k]]++] = (int)i;
+        }
+    }
+
+    vector<int> cachePosition(numVertices, -1);
+    vector<float> score(numVertices);
+    for (std::size_t v = 0; v < numVertices; v++) score[v] = vertexScore(tables, -1, remaining[v]);
+    vector<float> triangleScore(numTriangles);
+    vector<bool> emitted(numTriangles, false);
+    int best = 0;
+    for (std::size_t i = 0; i < numTriangles; i++) {
+        const Vec3i& t = triangles[i];
+        triangleScore[i] = score[t[0]] + score[t[1]] + score[t[2]];
+        if (triangleScore[i] > triangleScore[best]) best = (int)i;
+    }
+
+    // the cache holds up to three extra entries: the vertices pushed out by
+    // the last triangle, whose scores have to be updated once more
+    int cache[cacheSize + 3];
+    int cacheUsed = 0;
+    int newCache[cacheSize + 3];
+    vector<Vec3i> order;
+    order.reserve(numTriangles);
+    // where the search for a new start continues if the cache runs dry
+    std::size_t cursor = 0;
+
+    while (best >= 0) {
+        const Vec3i t = triangles[best];
+        order.push_back(t);
+        emitted[best] = true;
+
+        // remove the triangle from its vertices
+        for (int k = 0; k < 3; k++) {
+            int v = t[k];
+            int* list = &adjacency[first[v]];
+            int* last = list + remaining[v] - 1;
+            int* it = std::find(list, last + 1, best);
+            if (it <= last) {
+                *it = *last;
+                remaining[v]--;
+            }
+        }
+
+        // its corners move to the front of the cache
+        int newUsed = 0;
+        for (int k = 0; k < 3; k++) {
+            if (std::find(newCache, newCache + newUsed, t[k]) == newCache + newUsed) newCache[newUsed++] = t[k];
+        }
+        for (int i = 0; i < cacheUsed; i++) {
+            int v = cache[i];
+            if (v != t[0] && v != t[1] && v != t[2]) newCache[newUsed++] = v;
+        }
+
+        // new scores of all vertices the cache touched, and of their triangles
+        for (int i = 0; i < newUsed; i++) {
+            int v = newCache[i];
+            cachePosition[v] = i < cacheSize ? i : -1;
+            float s = vertexScore(tables, cachePosition[v], remaining[v]);
+            float delta = s - score[v];
+            score[v] = s;
+            for (int j = 0; j < remaining[v]; j++) triangleScore[adjacency[first[v] + j]] += delta;
+        }
+        // the next triangle is the best one using a cached vertex
+        best = -1;
+        float bestScore = -1.0f;
+        for (int i = 0; i < std::min(newUsed, cacheSize); i++) {
+            int v = newCache[i];
+            for (int j = 0; j < remaining[v]; j++) {
+                int tri = adjacency[first[v] + j];
+                if (triangleScore[tri] > bestScore) {
+                    bestScore = triangleScore[tri];
+                    best = tri;
+                }
+            }
+        }
+        cacheUsed = std::min(newUsed, cacheSize);
+        std::copy(newCache, newCache + cacheUsed, cache);
+
+        // nothing left around the cache: continue with the next triangle in
+        // file order. the cursor only moves forward, so this stays linear
+        if (best < 0) {
+            while (cursor < numTriangles && emitted[cursor]) cursor++;
+            if (cursor < numTriangles) best = (int)cursor;
+        }
+    }
+    triangles.swap(order);
+}
+
+std::size_t analyzeVertexFetch(const vector<Vec3i>& triangles, std::size_t numVertices,
+                               const vector<std::size_t>& strides, std::size_t lineSize,
+                               std::size_t cacheLines) {
+    // lines of all arrays are numbered one after the other. entered works
+    // like in analyzeVertexCache
+    vector<std::size_t> firstLine(strides.size() + 1, 0);
+    for (std::size_t a = 0; a < strides.size(); a++) {
+        firstLine[a + 1] = firstLine[a] + (numVertices * strides[a] + lineSize - 1) / lineSize;
+    }
+    vector<std::size_t> entered(firstLine.back(), 0);
+    std::size_t loads = 0;
+    for (const Vec3i& t : triangles) {
+        for (int k = 0; k < 3; k++) {
+            for (std::size_t a = 0; a < strides.size(); a++) {
+                // a vertex may straddle two lines
+                std::size_t begin = t[k] * strides[a];
+                std::size_t last = (begin + strides[a] - 1) / lineSize;
+                for (std::size_t line = begin / lineSize; line <= last; line++) {
+                    std::size_t& stamp = entered[firstLine[a] + line];
+                    if (stamp != 0 && loads - stamp < cacheLines) continue;
+                    loads++;
+                    stamp = loads;
+                }
+            }
+        }
+    }
+    return loads;
+}
+
+void optimizeVertexFetch(vector<Vec3i>& triangles, std::size_t numVertices, vector<int>& remap) {
+    remap.assign(numVertices, -1);
+    int next = 0;
+    for (Vec3i& t : triangles) {
+        for (int k = 0; k < 3; k++) {
+            int& index = remap[t[k]];
+            if (index < 0) index = next++;
+            t[k] = index;
+        }
+    }
+    for (std::size_t v = 0; v < numVertices; v++) {
+        if (remap[v] < 0) remap[v] = next++;
+    }
+}
+
+static inline Vec3f vertexPosition(const float* positions, std::size_t stride, int v) {
+    const float* p = (const float*)((const char*)positions + v * stride);
+    return Vec3f(p[0], p[1], p[2]);
+}
+
+struct OverdrawCluster {
+    std::size_t begin, end;
+    float sortKey;
+};
+
+std::size_t optimizeOverdraw(vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                             std::size_t numVertices, float threshold) {
+    const std::size_t numTriangles = triangles.size();
+    if (numTriangles == 0) return 0;
+
+    // runs of the vertex cache order: a triangle with three misses starts a
+    // new one, nothing is lost by cutting there
+    vector<unsigned char> misses(numTriangles);
+    FifoCache cache(numVertices);
+    for (std::size_t i = 0; i < numTriangles; i++) {
+        for (int k = 0; k < 3; k++) misses[i] += cache.access(triangles[i][k]) ? 1 : 0;
+    }
+    vector<std::size_t> runs;
+    for (std::size_t i = 0; i < numTriangles; i++) {
+        if (i == 0 || misses[i] == 3) runs.push_back(i);
+    }
+    runs.push_back(numTriangles);
+
+    // clusters: the runs split wherever the ACMR since the last split is low
+    // enough. the cache starts empty in each cluster as it will after sorting
+    vector<OverdrawCluster> clusters;
+    for (std::size_t r = 0; r + 1 < runs.size(); r++) {
+        std::size_t runMisses = 0;
+        for (std::size_t i = runs[r]; i < runs[r + 1]; i++) runMisses += misses[i];
+        double limit = threshold * (double)runMisses / (runs[r + 1] - runs[r]);
+        cache.flush();
+        std::size_t begin = runs[r], clusterMisses = 0;
+        for (std::size_t i = runs[r]; i < runs[r + 1]; i++) {
+            for (int k = 0; k < 3; k++) clusterMisses += cache.access(triangles[i][k]) ? 1 : 0;
+            if (i + 1 == runs[r + 1] || clusterMisses <= limit * (i + 1 - begin)) {
+                OverdrawCluster cluster = { begin, i + 1, 0.0f };
+                clusters.push_back(cluster);
+                begin = i + 1;
+                clusterMisses = 0;
+                cache.flush();
+            }
+        }
+    }
+
+    // area weighted centroids and normals
+    vector<Vec3f> centroids(clusters.size()), normals(clusters.size());
+    Vec3f meshCentroid;
+    double meshArea = 0.0;
+    for (std::size_t c = 0; c < clusters.size(); c++) {
+        Vec3f weighted;
+        double area = 0.0;
+        for (std::size_t i = clusters[c].begin; i < clusters[c].end; i++) {
+            Vec3f p0 = vertexPosition(positions, stride, triangles[i][0]);
+            Vec3f p1 = vertexPosition(positions, stride, triangles[i][1]);
+            Vec3f p2 = vertexPosition(positions, stride, triangles[i][2]);
+            Vec3f normal = (p1 - p0) ^ (p2 - p0);
+            float a = normal.length();
+            weighted += (p0 + p1 + p2) * (a / 3.0f);
+            normals[c] += normal;
+            area += a;
+        }
+        meshCentroid += weighted;
+        meshArea += area;
+        centroids[c] = area > 0.0 ? weighted * (float)(1.0 / area) : vertexPosition(positions, stride, triangles[clusters[c].begin][0]);
+        normals[c].normalize();
+    }
+    if (meshArea > 0.0) meshCentroid *= (float)(1.0 / meshArea);
+    // far out and facing outwards: likely to hide what is behind it
+    for (std::size_t c = 0; c < clusters.size(); c++) {
+        clusters[c].sortKey = (centroids[c] - meshCentroid) * normals[c];
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const OverdrawCluster& a, const OverdrawCluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    vector<Vec3i> order;
+    order.reserve(numTriangles);
+    for (const OverdrawCluster& cluster : clusters) {
+        order.insert(order.end(), triangles.begin() + cluster.begin, triangles.begin() + cluster.end);
+    }
+    triangles.swap(order);
+    return clusters.size();
+}
+
+// edge function: twice the signed area of (a, b, p)
+static inline float edge(float ax, float ay, float bx, float by, float px, float py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+OverdrawStats analyzeOverdraw(const vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                              std::size_t numVertices, int numViews, int resolution) {
+    OverdrawStats stats = { 0.0, 0, 0 };
+    if (triangles.empty() || numVertices == 0) return stats;
+
+    // bounding sphere (of the box) fills the image
+    Vec3f boundsMin = vertexPosition(positions, stride, 0), boundsMax = boundsMin;
+    for (std::size_t v = 0; v < numVertices; v++) {
+        Vec3f p = vertexPosition(positions, stride, (int)v);
+        for (int i = 0; i < 3; i++) {
+            boundsMin[i] = std::min(boundsMin[i], p[i]);
+            boundsMax[i] = std::max(boundsMax[i], p[i]);
+        }
+    }
+    Vec3f center = (boundsMin + boundsMax) * 0.5f;
+    float radius = std::max((boundsMax - boundsMin).length() * 0.5f, 1e-20f);
+    float scale = 0.5f * resolution / radius;
+
+    vector<float> depth((std::size_t)resolution * resolution);
+    vector<float> screen(3 * numVertices);
+    for (int view = 0; view < numViews; view++) {
+        // directions spread evenly over the sphere (Fibonacci lattice)
+        float z = 1.0f - (2.0f * view + 1.0f) / numViews;
+        float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+        float phi = view * 2.39996323f;
+        Vec3f dir(r * cosf(phi), r * sinf(phi), z);
+        Vec3f up = fabsf(dir.z) < 0.9f ? Vec3f(0.0f, 0.0f, 1.0f) : Vec3f(1.0f, 0.0f, 0.0f);
+        Vec3f right = (up ^ dir).normalized();
+        up = dir ^ right;
+
+        for (std::size_t v = 0; v < numVertices; v++) {
+            Vec3f p = vertexPosition(positions, stride, (int)v) - center;
+            screen[3 * v] = (p * right) * scale + 0.5f * resolution;
+            screen[3 * v + 1] = (p * up) * scale + 0.5f * resolution;
+            screen[3 * v + 2] = p * dir;
+        }
+        std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::infinity());
+
+        for (const Vec3i& t : triangles) {
+            const float* a = &screen[3 * t[0]];
+            const float* b = &screen[3 * t[1]];
+            const float* c = &screen[3 * t[2]];
+            float area = edge(a[0], a[1], b[0], b[1], c[0], c[1]);
+            if (area == 0.0f) continue;
+            // both windings are drawn
+            if (area < 0.0f) std::swap(b, c);
+            area = fabsf(area);
+            int x0 = std::max(0, (int)floorf(std::min(a[0], std::min(b[0], c[0]))));
+            int x1 = std::min(resolution - 1, (int)ceilf(std::max(a[0], std::max(b[0], c[0]))));
+            int y0 = std::max(0, (int)floorf(std::min(a[1], std::min(b[1], c[1]))));
+            int y1 = std::min(resolution - 1, (int)ceilf(std::max(a[1], std::max(b[1], c[1]))));
+            for (int y = y0; y <= y1; y++) {
+                float py = y + 0.5f;
+                for (int x = x0; x <= x1; x++) {
+                    float px = x + 0.5f;
+                    float w0 = edge(b[0], b[1], c[0], c[1], px, py);
+                    float w1 = edge(c[0], c[1], a[0], a[1], px, py);
+                    float w2 = edge(a[0], a[1], b[0], b[1], px, py);
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+                    float d = (w0 * a[2] + w1 * b[2] + w2 * c[2]) / area;
+                    float& stored = depth[(std::size_t)y * resolution + x];
+                    if (d < stored) {
+                        stored = d;
+                        stats.shaded++;
+                    }
+                }
+            }
+        }
+        for (float d : depth) {
+            if (d != std::numeric_limits<float>::infinity()) stats.covered++;
+        }
+    }
+    stats.overdraw = stats.covered == 0 ? 0.0 : (double)stats.shaded / stats.covered;
+    return stats;
+}
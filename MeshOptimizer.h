@@ -0,0 +1,73 @@
+#pragma once
+
+// Reordering passes for triangle meshes, working on the index buffer only.
+//
+// optimizeVertexCache orders triangles for the post-transform vertex cache
+// of the GPU: Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". It
+// simulates an LRU cache and always emits the triangle whose vertices score
+// best: vertices in the cache (the most recent ones most), and vertices with
+// few triangles left, so that no triangle is left behind alone.
+//
+// optimizeOverdraw reorders clusters of that order so that triangles likely
+// to occlude others come first (Sander et al., "Fast Triangle Reordering
+// for Vertex Locality and Reduced Overdraw"). The order within each cluster
+// stays, and the clusters are long enough to keep the vertex cache working.
+//
+// optimizeVertexFetch then renumbers the vertices in the order the index
+// buffer first uses them, so the vertex arrays are read front to back.
+
+#include <cstddef>
+#include <vector>
+#include "Vec3.h"
+
+using namespace std;
+
+// quality of a triangle order for a FIFO vertex cache of cacheSize entries.
+// acmr: transformed vertices per triangle (0.5 is ideal for large grids, 3 worst),
+// atvr: transformed vertices per referenced vertex (1 is ideal)
+struct VertexCacheStats {
+    double acmr;
+    double atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const vector<Vec3i>& triangles, std::size_t numVertices,
+                                    unsigned int cacheSize = 16);
+
+// reorders triangles in O(triangles). the corners of each triangle keep
+// their order, so the winding does not change
+void optimizeVertexCache(vector<Vec3i>& triangles, std::size_t numVertices);
+
+// reorders clusters of the triangles, which should be vertex cache
+// optimized. positions are the first three floats of each vertex, stride
+// bytes apart. a cluster ends where its ACMR (from an empty cache) is within
+// threshold times the ACMR of the whole run it belongs to, so the ACMR of
+// the result stays below about threshold times the one before. 1 keeps the
+// vertex cache order almost as is, larger values give more, smaller clusters.
+// clusters facing away from the center of the mesh come first. returns
+// the number of clusters
+std::size_t optimizeOverdraw(vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                             std::size_t numVertices, float threshold = 1.05f);
+
+// overdraw of triangles drawn in order with a depth test, measured by
+// rasterizing them (both sides, orthographic) at resolution x resolution
+// pixels from numViews directions around the mesh
+struct OverdrawStats {
+    // shaded fragments (those passing the depth test when drawn) per covered pixel
+    double overdraw;
+    std::size_t covered;
+    std::size_t shaded;
+};
+
+OverdrawStats analyzeOverdraw(const vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                              std::size_t numVertices, int numViews = 32, int resolution = 256);
+
+// cache lines of lineSize bytes loaded when the vertices of triangles are
+// read in index order from arrays with the given strides (one per attribute
+// array), through a FIFO cache of cacheLines lines
+std::size_t analyzeVertexFetch(const vector<Vec3i>& triangles, std::size_t numVertices,
+                               const vector<std::size_t>& strides, std::size_t lineSize = 64,
+                               std::size_t cacheLines = 64);
+
+// renumbers the vertices in order of first use and rewrites triangles.
+// remap[old] is the new index. unreferenced vertices go to the end
+void optimizeVertexFetch(vector<Vec3i>& triangles, std::size_t numVertices, vector<int>& remap);
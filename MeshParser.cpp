@@ -0,0 +1,240 @@
+#include "MeshParser.h"
+#include "FastParse.h"
+
+
+// ===========
+// === OBJ ===
+// ===========
+
+void ObjChunk::clear() {
+    positions.clear();
+    normals.clear();
+    texCoords.clear();
+    corners.clear();
+}
+
+// converts a 1-based or negative (relative) OBJ index. count is the number of
+// elements of this kind read so far in the chunk
+static inline void resolveIndex(int fileIndex, int count, int relativeBit, int& index, int& relative) {
+    if (fileIndex > 0) {
+        index = fileIndex - 1;
+    }
+    else if (fileIndex < 0) {
+        index = count + fileIndex;
+        relative |= relativeBit;
+    }
+    else {
+        index = -1;
+    }
+}
+
+// parses one corner "v", "v/vt", "v//vn" or "v/vt/vn"
+static inline bool parseCorner(const char*& p, const char* end, const ObjChunk& chunk, ObjCorner& c) {
+    int v = 0, vt = 0, vn = 0;
+    if (!parseInt(p, end, v)) return false;
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/') parseInt(p, end, vt);
+        if (p < end && *p == '/') {
+            ++p;
+            parseInt(p, end, vn);
+        }
+    }
+    // ignore anything else glued to the corner
+    p = skipToken(p, end);
+    c.relative = 0;
+    resolveIndex(v, (int)chunk.positions.size(), ObjCorner::RELATIVE_V, c.v, c.relative);
+    resolveIndex(vt, (int)chunk.texCoords.size(), ObjCorner::RELATIVE_VT, c.vt, c.relative);
+    resolveIndex(vn, (int)chunk.normals.size(), ObjCorner::RELATIVE_VN, c.vn, c.relative);
+    return true;
+}
+
+void parseOBJ(const char* begin, const char* end, ObjChunk& chunk) {
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        p = skipBlanks(p, lineEnd);
+        if (lineEnd - p >= 2) {
+            if (p[0] == 'v' && isBlank(p[1])) {
+                Vec3f v;
+                p += 2;
+                parseFloat(p, lineEnd, v.x);
+                parseFloat(p, lineEnd, v.y);
+                parseFloat(p, lineEnd, v.z);
+                chunk.positions.push_back(v);
+            }
+            else if (p[0] == 'v' && p[1] == 'n' && lineEnd - p >= 3 && isBlank(p[2])) {
+                Vec3f n;
+                p += 3;
+                parseFloat(p, lineEnd, n.x);
+                parseFloat(p, lineEnd, n.y);
+                parseFloat(p, lineEnd, n.z);
+                chunk.normals.push_back(n);
+            }
+            else if (p[0] == 'v' && p[1] == 't' && lineEnd - p >= 3 && isBlank(p[2])) {
+                TriangleMesh::Tex2D t;
+                p += 3;
+                parseFloat(p, lineEnd, t.u);
+                parseFloat(p, lineEnd, t.v);
+                chunk.texCoords.push_back(t);
+            }
+            else if (p[0] == 'f' && isBlank(p[1])) {
+                // fan triangulation of polygons: (0,1,2), (0,2,3), ...
+                ObjCorner first, previous, current;
+                int n = 0;
+                p += 2;
+                while (true) {
+                    p = skipBlanks(p, lineEnd);
+                    if (p == lineEnd || *p == '#') break;
+                    if (!parseCorner(p, lineEnd, chunk, current)) break;
+                    if (n == 0) first = current;
+                    else if (n >= 2) {
+                        chunk.corners.push_back(first);
+                        chunk.corners.push_back(previous);
+                        chunk.corners.push_back(current);
+                    }
+                    previous = current;
+                    ++n;
+                }
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+void clampOBJCorner(ObjCorner& c, int numPositions, int numTexCoords, int numNormals) {
+    if (c.v < 0 || c.v >= numPositions) c.v = -1;
+    if (c.vt < 0 || c.vt >= numTexCoords) c.vt = -1;
+    if (c.vn < 0 || c.vn >= numNormals) c.vn = -1;
+    c.relative = 0;
+}
+
+static inline unsigned int hashCorner(const ObjCorner& c) {
+    unsigned int h = (unsigned int)c.v * 0x9E3779B1u;
+    h ^= (unsigned int)c.vt * 0x85EBCA77u;
+    h ^= (unsigned int)c.vn * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 13;
+    return h;
+}
+
+ObjWelder::ObjWelder(std::size_t expected) {
+    std::size_t capacity = 16;
+    while (capacity < 2 * expected) capacity *= 2;
+    rehash(capacity);
+    unique.reserve(expected);
+}
+
+void ObjWelder::rehash(std::size_t capacity) {
+    slots.assign(capacity, -1);
+    mask = capacity - 1;
+    for (std::size_t u = 0; u < unique.size(); u++) {
+        std::size_t slot = hashCorner(unique[u]) & mask;
+        while (slots[slot] >= 0) slot = (slot + 1) & mask;
+        slots[slot] = (int)u;
+    }
+}
+
+int ObjWelder::add(const ObjCorner& c, bool& isNew) {
+    std::size_t slot = hashCorner(c) & mask;
+    while (true) {
+        int u = slots[slot];
+        if (u < 0) break;
+        const ObjCorner& o = unique[u];
+        if (o.v == c.v && o.vt == c.vt && o.vn == c.vn) {
+            isNew = false;
+            return u;
+        }
+        slot = (slot + 1) & mask;
+    }
+    isNew = true;
+    int u = (int)unique.size();
+    unique.push_back(c);
+    slots[slot] = u;
+    if (2 * unique.size() > slots.size()) rehash(2 * slots.size());
+    return u;
+}
+
+void weldOBJCorners(const vector<ObjCorner>& corners, vector<ObjCorner>& unique, vector<int>& indices) {
+    ObjWelder welder(corners.size());
+    indices.resize(corners.size());
+    bool isNew;
+    for (std::size_t i = 0; i < corners.size(); i++) {
+        indices[i] = welder.add(corners[i], isNew);
+    }
+    unique = welder.corners();
+}
+
+
+// =================
+// === OFF / LSA ===
+// =================
+
+// finds the next token, crossing lines and skipping comments
+static bool nextToken(const char*& p, const char* end, const char*& tokenEnd) {
+    while (p < end) {
+        if (isBlank(*p) || *p == '\n') {
+            ++p;
+        }
+        else if (*p == '#') {
+            p = findLineEnd(p, end);
+        }
+        else {
+            tokenEnd = skipToken(p, end);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* parseIndexedHeader(const char* begin, const char* end, const char* keyword,
+                               int& nv, int& nf, int& ne, float* baseline) {
+    const char* p = begin;
+    const char* tokenEnd;
+    std::size_t length = strlen(keyword);
+    if (!nextToken(p, end, tokenEnd) || (std::size_t)(tokenEnd - p) < length || memcmp(p, keyword, length) != 0) {
+        return nullptr;
+    }
+    int* counts[3] = { &nv, &nf, &ne };
+    for (int i = 0; i < 3; i++) {
+        p = tokenEnd;
+        if (!nextToken(p, end, tokenEnd) || !parseInt(p, tokenEnd, *counts[i])) return nullptr;
+    }
+    if (baseline) {
+        p = tokenEnd;
+        if (!nextToken(p, end, tokenEnd) || !parseFloat(p, tokenEnd, *baseline)) return nullptr;
+    }
+    // the body starts with the next line
+    p = findLineEnd(tokenEnd, end);
+    return p < end ? p + 1 : end;
+}
+
+std::size_t countDataLines(const char* begin, const char* end) {
+    std::size_t count = 0;
+    const char* p = begin;
+    while (p < end) {
+        const char* lineEnd = findLineEnd(p, end);
+        p = skipBlanks(p, lineEnd);
+        if (p < lineEnd && *p != '#') count++;
+        p = lineEnd + 1;
+    }
+    return count;
+}
+
+bool parseFaceLine(const char* p, const char* lineEnd, int nv, vector<Vec3i>& triangles) {
+    int n;
+    if (!parseInt(p, lineEnd, n) || n < 3) return false;
+    int first = 0, previous = 0, current = 0;
+    std::size_t start = triangles.size();
+    for (int k = 0; k < n; k++) {
+        if (!parseInt(p, lineEnd, current) || current < 0 || current >= nv) {
+            triangles.resize(start);
+            return false;
+        }
+        if (k == 0) first = current;
+        else if (k >= 2) triangles.push_back(Vec3i(first, previous, current));
+        previous = current;
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+// In place parsers for the text mesh formats. They work on a character range
+// (usually part of a MappedFile) and never allocate per token, so a file can
+// be split into chunks at line boundaries and parsed by several threads.
+
+#include <vector>
+#include "Vec3.h"
+#include "TriangleMesh.h"
+#include "FastParse.h"
+
+using namespace std;
+
+// one face corner of an OBJ file as 0-based indices into the position,
+// texture coordinate and normal lists. -1 marks a missing index.
+struct ObjCorner {
+    // bits of relative: index was negative in the file and counts from the
+    // start of the chunk. it becomes global after adding the element counts
+    // of all preceding chunks
+    enum { RELATIVE_V = 1, RELATIVE_VT = 2, RELATIVE_VN = 4 };
+    int v, vt, vn;
+    int relative;
+};
+
+// everything read from a range of OBJ lines
+struct ObjChunk {
+    vector<Vec3f> positions;
+    vector<Vec3f> normals;
+    vector<TriangleMesh::Tex2D> texCoords;
+    // three corners per triangle, polygons are fan triangulated
+    vector<ObjCorner> corners;
+
+    void clear();
+};
+
+// parses the OBJ records v, vt, vn and f in [begin, end). begin has to be the
+// start of a line. all other records (comments, groups, materials) are skipped
+void parseOBJ(const char* begin, const char* end, ObjChunk& chunk);
+
+// replaces out of range indices of already global corners by -1
+void clampOBJCorner(ObjCorner& c, int numPositions, int numTexCoords, int numNormals);
+
+// hash set of (v, vt, vn) index triples, numbering them in order of first use
+class ObjWelder {
+public:
+    // expected: number of distinct corners to make room for
+    explicit ObjWelder(std::size_t expected = 0);
+    // number of c among the distinct corners. isNew is set if c was not added before
+    int add(const ObjCorner& c, bool& isNew);
+    const vector<ObjCorner>& corners() const { return unique; }
+
+private:
+    void rehash(std::size_t capacity);
+    // open addressing with linear probing, at most half full
+    vector<int> slots;
+    std::size_t mask;
+    vector<ObjCorner> unique;
+};
+
+// merges corners with identical (v, vt, vn) index triples. unique receives
+// each distinct triple once (in order of first use) and indices[i] is the
+// position of corners[i] in unique
+void weldOBJCorners(const vector<ObjCorner>& corners, vector<ObjCorner>& unique, vector<int>& indices);
+
+// =================
+// === OFF / LSA ===
+// =================
+
+// reads the header "<keyword> nv nf ne" (and the baseline distance for LSA if
+// baseline is not null). returns the start of the line behind the header or
+// nullptr if the file does not start with keyword
+const char* parseIndexedHeader(const char* begin, const char* end, const char* keyword,
+                               int& nv, int& nf, int& ne, float* baseline);
+
+// number of lines in [begin, end) that are neither empty nor comments
+std::size_t countDataLines(const char* begin, const char* end);
+
+// part of the body of an OFF or LSA file: nv vertex lines followed by nf
+// face lines "n i0 i1 ... i(n-1)"
+struct IndexedChunk {
+    const char* begin;
+    const char* end;
+    // index of the first data line of this chunk within the body
+    std::size_t firstLine;
+    // faces of the chunk, fan triangulated
+    vector<Vec3i> triangles;
+    // faces with less than 3 or invalid vertex indices
+    std::size_t numBadFaces;
+};
+
+// reads a face line, appending its fan triangulation to triangles
+bool parseFaceLine(const char* p, const char* lineEnd, int nv, vector<Vec3i>& triangles);
+
+// parses the lines of chunk. vertex line i (< nv) with its three numbers is
+// handed to vertex(i, a, b, c), faces end up in chunk.triangles
+template<class VertexFunction>
+void parseIndexedChunk(IndexedChunk& chunk, int nv, int nf, VertexFunction vertex) {
+    std::size_t line = chunk.firstLine;
+    std::size_t numLines = (std::size_t)nv + (std::size_t)nf;
+    chunk.numBadFaces = 0;
+    const char* p = chunk.begin;
+    while (p < chunk.end && line < numLines) {
+        const char* lineEnd = findLineEnd(p, chunk.end);
+        p = skipBlanks(p, lineEnd);
+        if (p < lineEnd && *p != '#') {
+            if (line < (std::size_t)nv) {
+                float a, b, c;
+                parseFloat(p, lineEnd, a);
+                parseFloat(p, lineEnd, b);
+                parseFloat(p, lineEnd, c);
+                vertex(line, a, b, c);
+            }
+            else if (!parseFaceLine(p, lineEnd, nv, chunk.triangles)) {
+                chunk.numBadFaces++;
+            }
+            line++;
+        }
+        p = lineEnd + 1;
+    }
+}
@@ -0,0 +1,511 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_set>
+
+// border planes weigh more than triangle planes, borders keep their shape
+static const double borderWeight = 10.0;
+// smallest cosine between the normals of vertices merged across a seam
+static const float seamNormalCos = 0.7f;
+// share of the squared edge length in the order of the collapses. where the
+// quadric error is about 0 (flat regions) the shorter edges go first, so the
+// collapses spread out instead of piling onto one vertex
+static const double edgeLengthWeight = 1e-3;
+
+// symmetric 4x4 matrix of the squared distance to a set of planes, weighted
+// by triangle area. w is the total weight, so mergedError() is a mean
+struct Quadric {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double w;
+
+    Quadric()
+        : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), w(0) {
+    }
+    // plane a*x + b*y + c*z + d = 0 with |(a, b, c)| = 1
+    void addPlane(double a, double b, double c, double d, double weight) {
+        a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+        b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+        c2 += weight * c * c; cd += weight * c * d;
+        d2 += weight * d * d;
+        w += weight;
+    }
+    void add(const Quadric& q) {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+        w += q.w;
+    }
+    // weighted sum of the squared distances
+    double sum(double x, double y, double z) const {
+        return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+            + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+            + c2 * z * z + 2 * cd * z
+            + d2;
+    }
+};
+
+// error of the sum of two quadrics at p, without adding them up
+static inline double mergedError(const Quadric& a, const Quadric& b, const Vec3f& p) {
+    double w = a.w + b.w;
+    if (w <= 0.0) return 0.0;
+    return std::max(0.0, (a.sum(p.x, p.y, p.z) + b.sum(p.x, p.y, p.z)) / w);
+}
+
+struct Collapse {
+    double error;
+    // error plus the weighted squared edge length
+    double cost;
+    int to;
+};
+
+// binary min heap of groups by the cost of their collapse. position[g] is the
+// index of g in the heap or -1, a new cost moves g up or down in place, so
+// every group is in the heap once
+struct CollapseQueue {
+    vector<pair<float, int> > heap;
+    vector<int> position;
+
+    explicit CollapseQueue(std::size_t numGroups) : position(numGroups, -1) {
+    }
+    bool empty() const {
+        return heap.empty();
+    }
+    int top() const {
+        return heap[0].second;
+    }
+    void update(int g, float cost) {
+        int i = position[g];
+        if (i < 0) {
+            i = (int)heap.size();
+            heap.push_back(make_pair(cost, g));
+        }
+        else heap[i].first = cost;
+        place(siftDown(siftUp(i)));
+    }
+    void remove(int g) {
+        int i = position[g];
+        if (i < 0) return;
+        position[g] = -1;
+        heap[i] = heap.back();
+        heap.pop_back();
+        if (i < (int)heap.size()) place(siftDown(siftUp(i)));
+    }
+
+private:
+    // the moves write position[] of the entries they pass, place() that of the moved one
+    int siftUp(int i) {
+        pair<float, int> entry = heap[i];
+        while (i > 0 && entry < heap[(i - 1) / 2]) {
+            heap[i] = heap[(i - 1) / 2];
+            position[heap[i].second] = i;
+            i = (i - 1) / 2;
+        }
+        heap[i] = entry;
+        return i;
+    }
+    int siftDown(int i) {
+        pair<float, int> entry = heap[i];
+        const int n = (int)heap.size();
+        for (;;) {
+            int child = 2 * i + 1;
+            if (child >= n) break;
+            if (child + 1 < n && heap[child + 1] < heap[child]) child++;
+            if (!(heap[child] < entry)) break;
+            heap[i] = heap[child];
+            position[heap[i].second] = i;
+            i = child;
+        }
+        heap[i] = entry;
+        return i;
+    }
+    void place(int i) {
+        position[heap[i].second] = i;
+    }
+};
+
+// vertices per position group in CSR form: values of key k are value[first[k] .. first[k+1])
+struct Csr {
+    vector<std::size_t> first;
+    vector<int> value;
+};
+
+static inline const float* attribute(const float* data, std::size_t stride, int v) {
+    return (const float*)((const char*)data + v * stride);
+}
+
+static inline Vec3f position(const SimplifyVertices& vertices, int v) {
+    const float* p = attribute(vertices.positions, vertices.positionStride, v);
+    return Vec3f(p[0], p[1], p[2]);
+}
+
+struct PositionKey {
+    uint32_t x, y, z;
+    bool operator==(const PositionKey& o) const { return x == o.x && y == o.y && z == o.z; }
+};
+
+struct PositionKeyHash {
+    std::size_t operator()(const PositionKey& k) const {
+        uint64_t h = (uint64_t)k.x * 0x9E3779B97F4A7C15ull ^ (uint64_t)k.y * 0xC2B2AE3D27D4EB4Full
+            ^ (uint64_t)k.z * 0x165667B19E3779F9ull;
+        return (std::size_t)(h ^ (h >> 29));
+    }
+};
+
+static inline uint64_t edgeKey(int a, int b) {
+    return ((uint64_t)(uint32_t)std::min(a, b) << 32) | (uint32_t)std::max(a, b);
+}
+
+// vertices at one position with the same attributes are one corner of the
+// surface, even if the file did not share them
+static bool sameAttributes(const SimplifyVertices& vertices, int v, int w) {
+    if (vertices.texCoords) {
+        const float* a = attribute(vertices.texCoords, vertices.texCoordStride, v);
+        const float* b = attribute(vertices.texCoords, vertices.texCoordStride, w);
+        if (a[0] != b[0] || a[1] != b[1]) return false;
+    }
+    if (vertices.normals) {
+        const float* a = attribute(vertices.normals, vertices.normalStride, v);
+        const float* b = attribute(vertices.normals, vertices.normalStride, w);
+        if (a[0] != b[0] || a[1] != b[1] || a[2] != b[2]) return false;
+    }
+    return true;
+}
+
+// normal similarity of two vertices, 1 without normals
+static float normalCos(const SimplifyVertices& vertices, int v, int u) {
+    if (!vertices.normals) return 1.0f;
+    const float* a = attribute(vertices.normals, vertices.normalStride, v);
+    const float* b = attribute(vertices.normals, vertices.normalStride, u);
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+float simplifyMesh(const vector<Vec3i>& triangles, const SimplifyVertices& vertices,
+                   std::size_t targetTriangles, vector<Vec3i>& result) {
+    const std::size_t numVertices = vertices.count;
+    result = triangles;
+    if (triangles.size() <= targetTriangles || numVertices == 0) return 0.0f;
+
+    // group[v]: the first used vertex with the position of v. the simplifier
+    // works on groups, the vertices of a group are collapsed together. the
+    // vertices no triangle uses (those of finer levels) stay alone
+    vector<int> group(numVertices, -1);
+    std::size_t numUsed = 0;
+    for (const Vec3i& t : triangles) {
+        for (int k = 0; k < 3; k++) {
+            if (group[t[k]] < 0) {
+                group[t[k]] = t[k];
+                numUsed++;
+            }
+        }
+    }
+    {
+        // open addressing with linear probing, at most half full
+        std::size_t size = 1;
+        while (size < 2 * numUsed) size *= 2;
+        const std::size_t mask = size - 1;
+        vector<int> slots(size, -1);
+        vector<PositionKey> keys(numVertices);
+        for (std::size_t v = 0; v < numVertices; v++) {
+            if (group[v] < 0) {
+                group[v] = (int)v;
+                continue;
+            }
+            const float* p = attribute(vertices.positions, vertices.positionStride, (int)v);
+            PositionKey& key = keys[v];
+            memcpy(&key.x, &p[0], 4);
+            memcpy(&key.y, &p[1], 4);
+            memcpy(&key.z, &p[2], 4);
+            std::size_t slot = PositionKeyHash()(key) & mask;
+            while (slots[slot] >= 0 && !(keys[slots[slot]] == key)) slot = (slot + 1) & mask;
+            if (slots[slot] < 0) slots[slot] = (int)v;
+            group[v] = slots[slot];
+        }
+    }
+    Csr members;
+    members.first.assign(numVertices + 1, 0);
+    for (std::size_t v = 0; v < numVertices; v++) members.first[group[v] + 1]++;
+    for (std::size_t v = 0; v < numVertices; v++) members.first[v + 1] += members.first[v];
+    members.value.resize(numVertices);
+    {
+        vector<std::size_t> fill(members.first.begin(), members.first.end() - 1);
+        for (std::size_t v = 0; v < numVertices; v++) members.value[fill[group[v]]++] = (int)v;
+    }
+
+    // edges between groups with the number of triangles using them
+    vector<uint64_t> edges;
+    edges.reserve(3 * result.size());
+    for (const Vec3i& t : result) {
+        for (int k = 0; k < 3; k++) {
+            int a = group[t[k]], b = group[t[(k + 1) % 3]];
+            if (a != b) edges.push_back(edgeKey(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    // border edges (one triangle). groups with two border edges may move
+    // along the border, other border and non manifold ones stay
+    unordered_set<uint64_t> borderEdges;
+    vector<int> numBorderEdges(numVertices, 0);
+    vector<bool> locked(numVertices, false);
+    for (std::size_t i = 0; i < edges.size();) {
+        std::size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) j++;
+        int a = (int)(edges[i] >> 32), b = (int)(edges[i] & 0xffffffffu);
+        if (j - i == 1) {
+            borderEdges.insert(edges[i]);
+            numBorderEdges[a]++;
+            numBorderEdges[b]++;
+        }
+        else if (j - i > 2) {
+            locked[a] = true;
+            locked[b] = true;
+        }
+        i = j;
+    }
+    for (std::size_t g = 0; g < numVertices; g++) {
+        if (numBorderEdges[g] != 0 && numBorderEdges[g] != 2) locked[g] = true;
+    }
+    vector<uint64_t>().swap(edges);
+    auto isBorderEdge = [&](int a, int b) {
+        return borderEdges.count(edgeKey(a, b)) != 0;
+    };
+
+    // quadrics of the planes around each group, border edges add a plane
+    // through the edge perpendicular to their triangle
+    vector<Quadric> quadrics(numVertices);
+    for (const Vec3i& t : result) {
+        Vec3f p[3];
+        for (int k = 0; k < 3; k++) p[k] = position(vertices, t[k]);
+        Vec3f n = (p[1] - p[0]) ^ (p[2] - p[0]);
+        double area = 0.5 * n.length();
+        if (area <= 0.0) continue;
+        n.normalize();
+        double d = -(n * p[0]);
+        for (int k = 0; k < 3; k++) quadrics[group[t[k]]].addPlane(n.x, n.y, n.z, d, area);
+        for (int k = 0; k < 3; k++) {
+            int a = group[t[k]], b = group[t[(k + 1) % 3]];
+            if (a == b || numBorderEdges[a] == 0 || !isBorderEdge(a, b)) continue;
+            Vec3f edge = p[(k + 1) % 3] - p[k];
+            Vec3f side = edge ^ n;
+            if (!side.normalize()) continue;
+            double weight = borderWeight * (edge * edge);
+            double sd = -(side * p[k]);
+            quadrics[a].addPlane(side.x, side.y, side.z, sd, weight);
+            quadrics[b].addPlane(side.x, side.y, side.z, sd, weight);
+        }
+    }
+
+    // triangles around each vertex, kept up to date by the collapses. dead
+    // triangles leave the lists when they are walked
+    vector<vector<uint32_t> > around(numVertices);
+    vector<bool> alive(result.size(), true);
+    std::size_t numAlive = 0;
+    for (std::size_t i = 0; i < result.size(); i++) {
+        const Vec3i& t = result[i];
+        if (group[t[0]] == group[t[1]] || group[t[1]] == group[t[2]] || group[t[0]] == group[t[2]]) {
+            alive[i] = false;
+            continue;
+        }
+        for (int k = 0; k < 3; k++) around[t[k]].push_back((uint32_t)i);
+        numAlive++;
+    }
+    auto trianglesOf = [&](int v) -> const vector<uint32_t>& {
+        vector<uint32_t>& list = around[v];
+        list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t i) { return !alive[i]; }), list.end());
+        return list;
+    };
+    // groups next to g, each once
+    vector<uint32_t> seen(numVertices, 0);
+    uint32_t stamp = 0;
+    auto neighbours = [&](int g, vector<int>& groups) {
+        stamp++;
+        groups.clear();
+        for (std::size_t m = members.first[g]; m < members.first[g + 1]; m++) {
+            for (uint32_t i : trianglesOf(members.value[m])) {
+                const Vec3i& t = result[i];
+                for (int k = 0; k < 3; k++) {
+                    int other = group[t[k]];
+                    if (other != g && seen[other] != stamp) {
+                        seen[other] = stamp;
+                        groups.push_back(other);
+                    }
+                }
+            }
+        }
+    };
+
+    // the cheapest collapse of every free group into a neighbouring group,
+    // queued[g] is the collapse of g in the queue
+    vector<Collapse> queued(numVertices);
+    vector<bool> removed(numVertices, false);
+    CollapseQueue queue(numVertices);
+    auto consider = [&](int g, int target, Collapse& best) {
+        if (numBorderEdges[g] != 0 && !isBorderEdge(g, target)) return;
+        Vec3f from = position(vertices, g), to = position(vertices, target);
+        double e = mergedError(quadrics[g], quadrics[target], to);
+        double cost = e + edgeLengthWeight * ((to - from) * (to - from));
+        if (best.to < 0 || cost < best.cost) {
+            best.error = e;
+            best.cost = cost;
+            best.to = target;
+        }
+    };
+    auto enqueue = [&](int g, const Collapse& best) {
+        queued[g] = best;
+        if (best.to >= 0) queue.update(g, (float)best.cost);
+        else queue.remove(g);
+    };
+    // the cheapest of the collapses of g into the groups next to it
+    auto collapseAmong = [&](int g, const vector<int>& targets) {
+        Collapse best = { -1.0, -1.0, -1 };
+        for (int target : targets) consider(g, target, best);
+        enqueue(g, best);
+    };
+    vector<int> targets;
+    auto findCollapse = [&](int g) {
+        if (locked[g] || removed[g]) return;
+        neighbours(g, targets);
+        collapseAmong(g, targets);
+    };
+    for (std::size_t g = 0; g < numVertices; g++) {
+        if (group[g] == (int)g) findCollapse((int)g);
+    }
+
+    double maxError = 0.0;
+    // the vertex each member of a collapsing group moves to
+    vector<pair<int, int> > moves;
+    vector<int> changed;
+    while (numAlive > targetTriangles && !queue.empty()) {
+        const int from = queue.top();
+        const Collapse c = queued[from];
+        queue.remove(from);
+        queued[from].to = -1;
+        // the target went away with the last triangle from shared with it
+        if (removed[c.to]) {
+            findCollapse(from);
+            continue;
+        }
+        moves.clear();
+        bool valid = true;
+        for (std::size_t m = members.first[from]; m < members.first[from + 1] && valid; m++) {
+            int v = members.value[m];
+            if (trianglesOf(v).empty()) continue;
+            // the target vertex on the same side of the seam: next to v or
+            // to a vertex with the same attributes
+            int to = -1;
+            for (std::size_t n = members.first[from]; n < members.first[from + 1] && to < 0; n++) {
+                int w = members.value[n];
+                if (w != v && !sameAttributes(vertices, v, w)) continue;
+                for (uint32_t i : trianglesOf(w)) {
+                    if (to >= 0) break;
+                    const Vec3i& t = result[i];
+                    for (int k = 0; k < 3; k++) {
+                        if (group[t[k]] == c.to) to = t[k];
+                    }
+                }
+            }
+            // that side does not reach the target. without texture
+            // coordinates a vertex with a similar normal will do
+            if (to < 0 && !vertices.texCoords) {
+                float bestCos = seamNormalCos;
+                for (std::size_t n = members.first[c.to]; n < members.first[c.to + 1]; n++) {
+                    float cosine = normalCos(vertices, v, members.value[n]);
+                    if (cosine >= bestCos) {
+                        bestCos = cosine;
+                        to = members.value[n];
+                    }
+                }
+            }
+            if (to < 0) {
+                valid = false;
+                break;
+            }
+            moves.push_back(make_pair(v, to));
+            // no remaining triangle may flip
+            Vec3f target = position(vertices, to);
+            for (uint32_t i : trianglesOf(v)) {
+                const Vec3i& t = result[i];
+                if (group[t[0]] == c.to || group[t[1]] == c.to || group[t[2]] == c.to) continue;
+                Vec3f p[3], q[3];
+                for (int k = 0; k < 3; k++) {
+                    p[k] = position(vertices, t[k]);
+                    q[k] = t[k] == v ? target : p[k];
+                }
+                Vec3f before = (p[1] - p[0]) ^ (p[2] - p[0]);
+                Vec3f after = (q[1] - q[0]) ^ (q[2] - q[0]);
+                if (before * after <= 0.0f) {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+        // the other border edge of from moves to the target. one that exists
+        // already would close the border into a non manifold edge
+        int borderNeighbour = -1;
+        if (valid && numBorderEdges[from] != 0) {
+            neighbours(from, targets);
+            for (int other : targets) {
+                if (other != c.to && isBorderEdge(from, other)) borderNeighbour = other;
+            }
+            if (borderNeighbour >= 0 && isBorderEdge(c.to, borderNeighbour)) valid = false;
+        }
+        // tried again when its neighbourhood changes
+        if (!valid) continue;
+
+        for (const pair<int, int>& move : moves) {
+            for (uint32_t i : around[move.first]) {
+                if (!alive[i]) continue;
+                Vec3i& t = result[i];
+                for (int k = 0; k < 3; k++) {
+                    if (t[k] == move.first) t[k] = move.second;
+                }
+                // triangles with two corners in one group are gone
+                if (group[t[0]] == group[t[1]] || group[t[1]] == group[t[2]] || group[t[0]] == group[t[2]]) {
+                    alive[i] = false;
+                    numAlive--;
+                }
+                else around[move.second].push_back(i);
+            }
+            vector<uint32_t>().swap(around[move.first]);
+        }
+        if (borderNeighbour >= 0) {
+            borderEdges.erase(edgeKey(from, c.to));
+            borderEdges.erase(edgeKey(from, borderNeighbour));
+            borderEdges.insert(edgeKey(c.to, borderNeighbour));
+        }
+        quadrics[c.to].add(quadrics[from]);
+        removed[from] = true;
+        maxError = std::max(maxError, c.error);
+
+        // the target has a new quadric and new neighbours. around it the
+        // collapses into other groups keep their cost, so only those into
+        // from and those into the target that got dearer are found again,
+        // the others compete with the one into the target
+        neighbours(c.to, changed);
+        if (!locked[c.to]) collapseAmong(c.to, changed);
+        for (int g : changed) {
+            if (locked[g] || removed[g]) continue;
+            if (queued[g].to < 0 || queued[g].to == from) {
+                findCollapse(g);
+                continue;
+            }
+            Collapse best = { -1.0, -1.0, -1 };
+            consider(g, c.to, best);
+            if (queued[g].to == c.to) {
+                if (best.to >= 0 && best.cost <= queued[g].cost) enqueue(g, best);
+                else findCollapse(g);
+            }
+            else if (best.to >= 0 && best.cost < queued[g].cost) enqueue(g, best);
+        }
+    }
+
+    // the remaining triangles in their order
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < result.size(); i++) {
+        if (alive[i]) result[kept++] = result[i];
+    }
+    result.resize(kept);
+    return (float)sqrt(maxError);
+}
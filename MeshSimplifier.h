@@ -0,0 +1,38 @@
+#pragma once
+
+// Mesh simplification with quadric error metrics (Garland & Heckbert).
+// The mesh is reduced by half edge collapses: a vertex is merged into one of
+// its neighbours, so the result indexes the original vertex arrays and all
+// levels of detail can share them. Vertices at the same position (UV and
+// normal seams) collapse together, each onto the vertex of the target
+// position on its own side of the seam, so seams stay closed and attributes
+// are not smeared. Without texture coordinates a vertex with a similar
+// normal may stand in for a missing side.
+// Open borders only collapse along themselves, collapses that would flip a
+// triangle are rejected.
+
+#include <cstddef>
+#include <vector>
+#include "Vec3.h"
+
+using namespace std;
+
+// the vertex arrays the simplifier reads. each attribute starts at its
+// pointer, consecutive vertices are stride bytes apart. normals and
+// texCoords may be null
+struct SimplifyVertices {
+    const float* positions;
+    std::size_t positionStride;
+    const float* normals;
+    std::size_t normalStride;
+    const float* texCoords;
+    std::size_t texCoordStride;
+    std::size_t count;
+};
+
+// simplifies triangles to at most targetTriangles if the constraints allow
+// it. returns the geometric error of the result: the largest root mean
+// square distance of a merged vertex to the planes of the triangles it
+// stands for
+float simplifyMesh(const vector<Vec3i>& triangles, const SimplifyVertices& vertices,
+                   std::size_t targetTriangles, vector<Vec3i>& result);
@@ -0,0 +1,183 @@
+#include "MeshStream.h"
+#include "MappedFile.h"
+#include "MeshParser.h"
+#include "LaserScan.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <thread>
+
+// the first piece is small so that something shows up quickly, later pieces
+// grow to keep the locking overhead low
+static const std::size_t firstPieceSize = 64 * 1024;
+static const std::size_t maxPieceSize = 4 * 1024 * 1024;
+
+MeshStream::MeshStream()
+    : done(false), failed(false), weldVertices(true) {
+}
+
+template<class T>
+static void appendTo(vector<T>& target, vector<T>& source) {
+    if (target.empty()) target.swap(source);
+    else target.insert(target.end(), source.begin(), source.end());
+    source.clear();
+}
+
+void MeshStream::publish(vector<Vec3f>& newVertices, vector<Vec3f>& newNormals,
+                         vector<TriangleMesh::Tex2D>& newTextures, vector<Vec3i>& newTriangles) {
+    allVertices.insert(allVertices.end(), newVertices.begin(), newVertices.end());
+    allNormals.insert(allNormals.end(), newNormals.begin(), newNormals.end());
+    allTextures.insert(allTextures.end(), newTextures.begin(), newTextures.end());
+    allTriangles.insert(allTriangles.end(), newTriangles.begin(), newTriangles.end());
+    std::lock_guard<std::mutex> lock(mutex);
+    appendTo(vertices, newVertices);
+    appendTo(normals, newNormals);
+    appendTo(textures, newTextures);
+    appendTo(triangles, newTriangles);
+}
+
+void MeshStream::finish(bool ok) {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    failed = !ok;
+}
+
+// end of the next piece starting at p, at a line boundary
+static const char* nextPiece(const char* p, const char* end, std::size_t& size) {
+    const char* q = (std::size_t)(end - p) > size ? findLineEnd(p + size, end) : end;
+    size = std::min(2 * size, maxPieceSize);
+    return q < end ? q + 1 : end;
+}
+
+template<class T>
+static inline T streamAttribute(const vector<T>& list, int index) {
+    if (index < 0) return T();
+    return list[index];
+}
+
+static bool streamOBJ(MeshStream& stream, const MappedFile& file) {
+    // everything read so far, faces may refer to any of it
+    ObjChunk all, piece;
+    ObjWelder welder;
+    int numVertices = 0;
+    vector<Vec3f> newVertices, newNormals;
+    vector<TriangleMesh::Tex2D> newTextures;
+    vector<Vec3i> newTriangles;
+
+    std::size_t size = firstPieceSize;
+    const char* p = file.data();
+    while (p < file.end()) {
+        const char* q = nextPiece(p, file.end(), size);
+        piece.clear();
+        parseOBJ(p, q, piece);
+        int positionBase = (int)all.positions.size();
+        int normalBase = (int)all.normals.size();
+        int texCoordBase = (int)all.texCoords.size();
+        all.positions.insert(all.positions.end(), piece.positions.begin(), piece.positions.end());
+        all.normals.insert(all.normals.end(), piece.normals.begin(), piece.normals.end());
+        all.texCoords.insert(all.texCoords.end(), piece.texCoords.begin(), piece.texCoords.end());
+
+        int corner[3];
+        for (std::size_t i = 0; i < piece.corners.size(); i++) {
+            ObjCorner c = piece.corners[i];
+            if (c.relative & ObjCorner::RELATIVE_V) c.v += positionBase;
+            if (c.relative & ObjCorner::RELATIVE_VN) c.vn += normalBase;
+            if (c.relative & ObjCorner::RELATIVE_VT) c.vt += texCoordBase;
+            clampOBJCorner(c, (int)all.positions.size(), (int)all.texCoords.size(), (int)all.normals.size());
+            bool isNew = true;
+            int index = stream.weldVertices ? welder.add(c, isNew) : numVertices;
+            if (isNew) {
+                newVertices.push_back(streamAttribute(all.positions, c.v));
+                newNormals.push_back(streamAttribute(all.normals, c.vn));
+                newTextures.push_back(streamAttribute(all.texCoords, c.vt));
+                numVertices++;
+            }
+            corner[i % 3] = index;
+            if (i % 3 == 2) newTriangles.push_back(Vec3i(corner[0], corner[1], corner[2]));
+        }
+        stream.publish(newVertices, newNormals, newTextures, newTriangles);
+        p = q;
+    }
+    return true;
+}
+
+static bool streamIndexed(MeshStream& stream, const MappedFile& file, bool laserScan) {
+    int nv, nf, ne;
+    float baseline = 0.0f;
+    const char* body = parseIndexedHeader(file.data(), file.end(), laserScan ? "LSA" : "OFF",
+                                          nv, nf, ne, laserScan ? &baseline : nullptr);
+    if (body == nullptr || nv <= 0 || nf <= 0) return false;
+
+    // OFF: vertices, LSA: the three angles of each vertex
+    vector<Vec3f> values(nv);
+    vector<Vec3f> newNormals;
+    vector<TriangleMesh::Tex2D> newTextures;
+    bool verticesPublished = false;
+
+    IndexedChunk chunk;
+    chunk.firstLine = 0;
+    std::size_t size = firstPieceSize;
+    const char* p = body;
+    while (p < file.end() && chunk.firstLine < (std::size_t)nv + nf) {
+        chunk.begin = p;
+        chunk.end = nextPiece(p, file.end(), size);
+        parseIndexedChunk(chunk, nv, nf, [&](std::size_t line, float a, float b, float c) {
+            values[line] = Vec3f(a, b, c);
+        });
+        chunk.firstLine += countDataLines(chunk.begin, chunk.end);
+        // faces can only be shown once all vertices are there
+        if (!verticesPublished && (chunk.firstLine >= (std::size_t)nv || chunk.end == file.end())) {
+            if (laserScan) {
+                vector<float> alpha(nv), beta(nv), gamma(nv);
+                for (int i = 0; i < nv; i++) {
+                    alpha[i] = values[i].x;
+                    beta[i] = values[i].y;
+                    gamma[i] = values[i].z;
+                }
+                laserScanToCartesian(alpha.data(), beta.data(), gamma.data(), nv, baseline, values.data());
+            }
+            newNormals.resize(nv);
+            stream.publish(values, newNormals, newTextures, chunk.triangles);
+            verticesPublished = true;
+        }
+        else if (verticesPublished) {
+            vector<Vec3f> noVertices, noNormals;
+            stream.publish(noVertices, noNormals, newTextures, chunk.triangles);
+        }
+        p = chunk.end;
+    }
+    return true;
+}
+
+static void runMeshStream(shared_ptr<MeshStream> stream) {
+    string extension = stream->filename.substr(std::min(stream->filename.size(), stream->filename.rfind('.') + 1));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+    MappedFile file;
+    bool ok = false;
+    if (!file.open(stream->filename.c_str())) {
+        cout << "loadStreaming: can not find " << stream->filename << endl;
+    }
+    else if (extension == "obj") {
+        ok = streamOBJ(*stream, file);
+    }
+    else if (extension == "off" || extension == "lsa") {
+        ok = streamIndexed(*stream, file, extension == "lsa");
+    }
+    else {
+        cout << "loadStreaming: unknown file type " << stream->filename << endl;
+    }
+    if (ok) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - stream->start).count();
+        cout << "loadStreaming: " << stream->filename << ": " << stream->allTriangles.size() << " triangles in "
+             << seconds * 1000.0 << " ms" << endl;
+        // the render thread keeps drawing the pieces meanwhile
+        stream->result->finishStreamedLoad(stream->allVertices, stream->allNormals, stream->allTextures,
+                                           stream->allTriangles, stream->filename.c_str());
+    }
+    stream->finish(ok);
+}
+
+void startMeshStream(shared_ptr<MeshStream> stream) {
+    // the thread owns a reference, so it may outlive the mesh that started it
+    std::thread(runMeshStream, stream).detach();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// Progressive loading: a background thread parses a mesh file piece by piece
+// and publishes finished vertices and triangles into a MeshStream. The mesh
+// takes them over on the render thread (TriangleMesh::updateStream), so it can
+// be drawn while the rest of the file is still being read. After the last
+// piece the thread also runs the passes of finishLoad on the whole mesh, the
+// render thread swaps it in and only uploads it.
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Vec3.h"
+#include "TriangleMesh.h"
+
+using namespace std;
+
+struct MeshStream {
+    MeshStream();
+
+    // appends to the published data. triangles may only refer to vertices
+    // published before or in the same call
+    void publish(vector<Vec3f>& newVertices, vector<Vec3f>& newNormals,
+                 vector<TriangleMesh::Tex2D>& newTextures, vector<Vec3i>& newTriangles);
+    // marks the load as finished
+    void finish(bool ok);
+
+    std::mutex mutex;
+    // published data that the mesh did not take over yet (guarded by mutex)
+    vector<Vec3f> vertices;
+    vector<Vec3f> normals;
+    vector<TriangleMesh::Tex2D> textures;
+    vector<Vec3i> triangles;
+    bool done;
+    bool failed;
+
+    // set before the thread starts
+    string filename;
+    bool weldVertices;
+    chrono::steady_clock::time_point start;
+    // an empty mesh with the load options of the streaming one. the thread
+    // finishes the load in it before done, the mesh takes it over after
+    unique_ptr<TriangleMesh> result;
+
+    // thread only: everything published so far, for result
+    vector<Vec3f> allVertices;
+    vector<Vec3f> allNormals;
+    vector<TriangleMesh::Tex2D> allTextures;
+    vector<Vec3i> allTriangles;
+
+    // render thread only: sums of file normals and face normals of all taken
+    // over triangles, normalized they are the normals calculateNormals gives
+    vector<Vec3f> normalSums;
+};
+
+// starts the background thread loading stream->filename (OBJ, OFF or LSA)
+void startMeshStream(shared_ptr<MeshStream> stream);
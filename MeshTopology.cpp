@@ -0,0 +1,261 @@
+#include "MeshTopology.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// below this many items per thread starting threads costs more than it saves
+static const std::size_t minItemsPerThread = 32 * 1024;
+
+unsigned int topologyThreadCount(std::size_t count, unsigned int numThreads) {
+    if (numThreads == 0) numThreads = defaultThreadCount();
+    return (unsigned int)std::max<std::size_t>(1, std::min<std::size_t>(numThreads, count / minItemsPerThread));
+}
+
+MeshTopology::MeshTopology()
+    : triangles(nullptr), numTriangles(0), numBorderEdges(0), numNonManifoldEdges(0) {
+}
+
+void MeshTopology::clear() {
+    triangles = nullptr;
+    numTriangles = 0;
+    vector<uint32_t>().swap(vertexTriangleFirst);
+    vector<uint32_t>().swap(vertexTriangleList);
+    vector<int>().swap(opposites);
+    numBorderEdges = 0;
+    numNonManifoldEdges = 0;
+}
+
+void MeshTopology::build(const Vec3i* triangleList, std::size_t count, std::size_t numVertices,
+                         unsigned int numThreads) {
+    triangles = triangleList;
+    numTriangles = count;
+    buildVertexTriangles(numVertices, numThreads);
+    buildOpposites(numThreads);
+}
+
+void MeshTopology::buildVertexTriangles(std::size_t numVertices, unsigned int numThreads) {
+    const std::size_t count = numTriangles;
+    vertexTriangleFirst.assign(numVertices + 1, 0);
+    vertexTriangleList.resize(3 * count);
+    unsigned int numBlocks = topologyThreadCount(count, numThreads);
+    if (numBlocks == 1) {
+        // counting sort, the triangles of each vertex come out ascending
+        for (std::size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) vertexTriangleFirst[triangles[i][k] + 1]++;
+        }
+        for (std::size_t v = 0; v < numVertices; v++) vertexTriangleFirst[v + 1] += vertexTriangleFirst[v];
+        vector<uint32_t> cursor(vertexTriangleFirst.begin(), vertexTriangleFirst.end() - 1);
+        for (std::size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) vertexTriangleList[cursor[triangles[i][k]]++] = (uint32_t)i;
+        }
+        return;
+    }
+
+    // the same with atomic counters, blocks of triangles per thread. the
+    // lists get filled in any order and are sorted afterwards
+    unique_ptr<std::atomic<uint32_t>[]> cursor(new std::atomic<uint32_t>[numVertices]);
+    unsigned int numVertexBlocks = topologyThreadCount(numVertices, numThreads);
+    parallelFor(numVertexBlocks, [&](unsigned int b) {
+        std::size_t last = numVertices * (b + 1) / numVertexBlocks;
+        for (std::size_t v = numVertices * b / numVertexBlocks; v < last; v++) cursor[v].store(0, std::memory_order_relaxed);
+    });
+    parallelFor(numBlocks, [&](unsigned int b) {
+        std::size_t last = count * (b + 1) / numBlocks;
+        for (std::size_t i = count * b / numBlocks; i < last; i++) {
+            for (int k = 0; k < 3; k++) cursor[triangles[i][k]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    for (std::size_t v = 0; v < numVertices; v++) {
+        vertexTriangleFirst[v + 1] = vertexTriangleFirst[v] + cursor[v].load(std::memory_order_relaxed);
+        cursor[v].store(vertexTriangleFirst[v], std::memory_order_relaxed);
+    }
+    parallelFor(numBlocks, [&](unsigned int b) {
+        std::size_t last = count * (b + 1) / numBlocks;
+        for (std::size_t i = count * b / numBlocks; i < last; i++) {
+            for (int k = 0; k < 3; k++) {
+                vertexTriangleList[cursor[triangles[i][k]].fetch_add(1, std::memory_order_relaxed)] = (uint32_t)i;
+            }
+        }
+    });
+    // the lists are short (about six triangles), insertion sort is enough
+    parallelFor(numVertexBlocks, [&](unsigned int b) {
+        std::size_t last = numVertices * (b + 1) / numVertexBlocks;
+        for (std::size_t v = numVertices * b / numVertexBlocks; v < last; v++) {
+            uint32_t* first = &vertexTriangleList[0] + vertexTriangleFirst[v];
+            uint32_t* end = &vertexTriangleList[0] + vertexTriangleFirst[v + 1];
+            for (uint32_t* p = first + 1; p < end; p++) {
+                uint32_t value = *p;
+                uint32_t* q = p;
+                for (; q > first && q[-1] > value; q--) *q = q[-1];
+                *q = value;
+            }
+        }
+    });
+}
+
+void MeshTopology::buildOpposites(unsigned int numThreads) {
+    // every half edge leaves one vertex, and its opposite ends there. so each
+    // vertex pairs the half edges leaving it with the ones arriving, among
+    // its own triangles. blocks of vertices write disjoint half edges
+    opposites.resize(3 * numTriangles);
+    const std::size_t numVertices = getNumVertices();
+    unsigned int numBlocks = topologyThreadCount(3 * numTriangles, numThreads);
+    vector<std::size_t> borders(numBlocks), nonManifold(numBlocks);
+    parallelFor(numBlocks, [&](unsigned int block) {
+        // the half edges at one vertex: other end and index
+        struct End {
+            int vertex;
+            uint32_t halfEdge;
+        };
+        vector<End> leaving, arriving;
+        std::size_t last = numVertices * (block + 1) / numBlocks;
+        for (std::size_t v = numVertices * block / numBlocks; v < last; v++) {
+            Range around = vertexTriangles(v);
+            if (leaving.size() < 2 * around.size()) {
+                leaving.resize(2 * around.size());
+                arriving.resize(2 * around.size());
+            }
+            std::size_t numEnds = 0;
+            uint32_t previous = (uint32_t)-1;
+            for (uint32_t t : around) {
+                const Vec3i& triangle = triangles[t];
+                int corners = (triangle[0] == (int)v) + (triangle[1] == (int)v) + (triangle[2] == (int)v);
+                if (corners == 1) {
+                    int k = triangle[0] == (int)v ? 0 : triangle[1] == (int)v ? 1 : 2;
+                    End out = { triangle[(k + 1) % 3], 3 * t + k };
+                    End in = { triangle[(k + 2) % 3], 3 * t + (k + 2) % 3 };
+                    leaving[numEnds] = out;
+                    arriving[numEnds++] = in;
+                }
+                else if (t != previous) {
+                    // uses v twice and is listed twice, once is enough
+                    for (int k = 0; k < 3; k++) {
+                        if (triangle[k] != (int)v) continue;
+                        End out = { triangle[(k + 1) % 3], 3 * t + k };
+                        End in = { triangle[(k + 2) % 3], 3 * t + (k + 2) % 3 };
+                        leaving[numEnds] = out;
+                        arriving[numEnds++] = in;
+                    }
+                }
+                previous = t;
+            }
+            for (std::size_t i = 0; i < numEnds; i++) {
+                const End& out = leaving[i];
+                // all other half edges between v and out.vertex, in any
+                // direction. without branches, the matches are unpredictable
+                int partner = BORDER;
+                int sharing = 0;
+                for (std::size_t j = 0; j < numEnds; j++) {
+                    const End& in = arriving[j];
+                    int match = in.vertex == out.vertex;
+                    partner = match ? (int)in.halfEdge : partner;
+                    sharing += match;
+                }
+                for (std::size_t j = 0; j < numEnds; j++) {
+                    sharing += (leaving[j].vertex == out.vertex) & (leaving[j].halfEdge != out.halfEdge);
+                }
+                if (sharing == 0) borders[block]++;
+                else if (sharing > 1) {
+                    partner = NON_MANIFOLD;
+                    nonManifold[block]++;
+                }
+                else if (partner == BORDER) {
+                    // the neighbour has the other orientation
+                    partner = NON_MANIFOLD;
+                    nonManifold[block]++;
+                }
+                opposites[out.halfEdge] = partner;
+            }
+        }
+    });
+    numBorderEdges = 0;
+    numNonManifoldEdges = 0;
+    for (unsigned int block = 0; block < numBlocks; block++) {
+        numBorderEdges += borders[block];
+        numNonManifoldEdges += nonManifold[block];
+    }
+}
+
+bool MeshTopology::isBuiltFor(const Vec3i* triangleList, std::size_t count, std::size_t numVertices) const {
+    return !vertexTriangleFirst.empty() && triangles == triangleList && numTriangles == count &&
+        getNumVertices() == numVertices;
+}
+
+std::size_t MeshTopology::getNumVertices() const {
+    return vertexTriangleFirst.empty() ? 0 : vertexTriangleFirst.size() - 1;
+}
+
+std::size_t MeshTopology::getNumTriangles() const {
+    return numTriangles;
+}
+
+MeshTopology::Range MeshTopology::vertexTriangles(std::size_t v) const {
+    const uint32_t* list = vertexTriangleList.data();
+    Range range = { list + vertexTriangleFirst[v], list + vertexTriangleFirst[v + 1] };
+    return range;
+}
+
+int MeshTopology::opposite(std::size_t halfEdge) const {
+    return opposites[halfEdge];
+}
+
+int MeshTopology::from(std::size_t halfEdge) const {
+    return triangles[halfEdge / 3][halfEdge % 3];
+}
+
+int MeshTopology::to(std::size_t halfEdge) const {
+    return triangles[halfEdge / 3][(halfEdge + 1) % 3];
+}
+
+bool MeshTopology::isBorderVertex(std::size_t v) const {
+    for (uint32_t t : vertexTriangles(v)) {
+        for (int k = 0; k < 3; k++) {
+            // the two half edges of t at v
+            bool atV = (std::size_t)triangles[t][k] == v || (std::size_t)triangles[t][(k + 1) % 3] == v;
+            if (atV && opposites[3 * t + k] < 0) return true;
+        }
+    }
+    return false;
+}
+
+void MeshTopology::oneRing(std::size_t v, vector<uint32_t>& ring) const {
+    ring.clear();
+    for (uint32_t t : vertexTriangles(v)) {
+        for (int k = 0; k < 3; k++) {
+            if ((std::size_t)triangles[t][k] != v) ring.push_back((uint32_t)triangles[t][k]);
+        }
+    }
+    std::sort(ring.begin(), ring.end());
+    ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+}
+
+void MeshTopology::edgeTriangles(std::size_t a, std::size_t b, vector<uint32_t>& result) const {
+    result.clear();
+    uint32_t previous = (uint32_t)-1;
+    for (uint32_t t : vertexTriangles(a)) {
+        if (t == previous) continue;
+        previous = t;
+        const Vec3i& triangle = triangles[t];
+        for (int k = 0; k < 3; k++) {
+            int c = triangle[k], d = triangle[(k + 1) % 3];
+            if (((std::size_t)c == a && (std::size_t)d == b) || ((std::size_t)c == b && (std::size_t)d == a)) {
+                result.push_back(t);
+                break;
+            }
+        }
+    }
+}
+
+std::size_t MeshTopology::getNumBorderEdges() const {
+    return numBorderEdges;
+}
+
+std::size_t MeshTopology::getNumNonManifoldEdges() const {
+    return numNonManifoldEdges;
+}
+
+std::size_t MeshTopology::memoryBytes() const {
+    return vertexTriangleFirst.capacity() * sizeof(uint32_t) + vertexTriangleList.capacity() * sizeof(uint32_t)
+        + opposites.capacity() * sizeof(int);
+}
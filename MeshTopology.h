@@ -0,0 +1,89 @@
+#pragma once
+
+// Adjacency of a triangle mesh, built in O(n) by counting and stored in
+// flat arrays:
+// - per vertex the triangles using it, in CSR form (an offset per vertex
+//   into one flat list),
+// - per half edge its opposite. Half edge 3 * t + k of triangle t runs from
+//   corner k to corner k + 1 (mod 3), so the triangle list itself holds the
+//   rest of the half edge structure.
+// The work of build is split over several threads.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Vec3.h"
+
+using namespace std;
+
+class MeshTopology
+{
+public:
+    // opposite() of half edges without a partner
+    enum { BORDER = -1, NON_MANIFOLD = -2 };
+
+    // [first, last) of a CSR list, usable in range based for loops
+    struct Range {
+        const uint32_t* first;
+        const uint32_t* last;
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+        std::size_t size() const { return last - first; }
+    };
+
+    MeshTopology();
+
+    // builds the adjacency of triangles referring to numVertices vertices on
+    // numThreads threads (0 = one per core). the result does not depend on
+    // numThreads. triangles has to stay alive and unchanged while the
+    // topology is used
+    void build(const Vec3i* triangles, std::size_t numTriangles, std::size_t numVertices,
+               unsigned int numThreads = 1);
+    void clear();
+
+    // built from exactly this triangle array
+    bool isBuiltFor(const Vec3i* triangles, std::size_t numTriangles, std::size_t numVertices) const;
+    std::size_t getNumVertices() const;
+    std::size_t getNumTriangles() const;
+
+    // triangles using vertex v in ascending order. a degenerate triangle
+    // using v twice is listed twice
+    Range vertexTriangles(std::size_t v) const;
+
+    // the half edge running the other way in the neighbouring triangle.
+    // BORDER if there is none, NON_MANIFOLD if more than two triangles share
+    // the edge or a neighbour has the opposite orientation
+    int opposite(std::size_t halfEdge) const;
+    // first and second vertex of a half edge
+    int from(std::size_t halfEdge) const;
+    int to(std::size_t halfEdge) const;
+    // a vertex on a border or non manifold edge
+    bool isBorderVertex(std::size_t v) const;
+    // the vertices sharing an edge with v, ascending, replaces ring
+    void oneRing(std::size_t v, vector<uint32_t>& ring) const;
+    // the triangles using the edge between a and b in any direction, ascending
+    void edgeTriangles(std::size_t a, std::size_t b, vector<uint32_t>& edgeTriangles) const;
+
+    // half edges with opposite() BORDER and NON_MANIFOLD
+    std::size_t getNumBorderEdges() const;
+    std::size_t getNumNonManifoldEdges() const;
+    // bytes held by the topology
+    std::size_t memoryBytes() const;
+
+private:
+    const Vec3i* triangles;
+    std::size_t numTriangles;
+    // vertexTriangles[vertexTriangleFirst[v] .. vertexTriangleFirst[v + 1])
+    vector<uint32_t> vertexTriangleFirst;
+    vector<uint32_t> vertexTriangleList;
+    // per half edge
+    vector<int> opposites;
+    std::size_t numBorderEdges, numNonManifoldEdges;
+
+    void buildVertexTriangles(std::size_t numVertices, unsigned int numThreads);
+    void buildOpposites(unsigned int numThreads);
+};
+
+// number of threads worth starting for count items, at most numThreads
+// (0 = one per core)
+unsigned int topologyThreadCount(std::size_t count, unsigned int numThreads);
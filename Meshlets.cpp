@@ -0,0 +1,250 @@
+#include "Meshlets.h"
+#include "MeshOptimizer.h"
+#include "MeshTopology.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// cost of a triangle turned away from the meshlet normal (1 - cosine)
+// against the vertices it adds. higher values give tighter cones and more,
+// smaller meshlets
+static const float normalWeight = 2.0f;
+
+static inline Vec3f vertexPosition(const float* positions, std::size_t stride, int v) {
+    const float* p = (const float*)((const char*)positions + stride * v);
+    return Vec3f(p[0], p[1], p[2]);
+}
+
+// unit normal of t, zero if it is degenerate
+static inline Vec3f unitNormal(const float* positions, std::size_t stride, const Vec3i& t) {
+    Vec3f p1 = vertexPosition(positions, stride, t[0]);
+    Vec3f n = (p1 - vertexPosition(positions, stride, t[1])) ^ (p1 - vertexPosition(positions, stride, t[2]));
+    if (!n.normalize()) return Vec3f();
+    return n;
+}
+
+void computeMeshletBounds(Meshlet& meshlet, const Vec3i* triangles, const float* positions, std::size_t stride,
+                          bool withCone) {
+    const Vec3i* first = triangles + meshlet.firstTriangle;
+    const Vec3i* last = first + meshlet.numTriangles;
+    Vec3f min = vertexPosition(positions, stride, (*first)[0]);
+    Vec3f max = min;
+    for (const Vec3i* t = first; t != last; ++t) {
+        for (int k = 0; k < 3; k++) {
+            Vec3f p = vertexPosition(positions, stride, (*t)[k]);
+            for (int i = 0; i < 3; i++) {
+                min[i] = std::min(min[i], p[i]);
+                max[i] = std::max(max[i], p[i]);
+            }
+        }
+    }
+    meshlet.center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for (const Vec3i* t = first; t != last; ++t) {
+        for (int k = 0; k < 3; k++) {
+            radius = std::max(radius, (vertexPosition(positions, stride, (*t)[k]) - meshlet.center).sqlength());
+        }
+    }
+    meshlet.radius = sqrtf(radius);
+
+    meshlet.coneAxis.clear();
+    meshlet.coneCutoff = 1.0f;
+    if (!withCone) return;
+    Vec3f axis;
+    for (const Vec3i* t = first; t != last; ++t) axis += unitNormal(positions, stride, *t);
+    if (!axis.normalize()) return;
+    float minCosine = 1.0f;
+    for (const Vec3i* t = first; t != last; ++t) {
+        Vec3f n = unitNormal(positions, stride, *t);
+        if (n != Vec3f()) minCosine = std::min(minCosine, n * axis);
+    }
+    // some normal 90 degrees or more off the axis: there is always a front face
+    if (minCosine <= 0.0f) return;
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = sqrtf(1.0f - minCosine * minCosine);
+}
+
+// triangles with vertices at the same position merged into one, so texture
+// and normal seams do not split the surface
+static void weldPositions(const vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                          std::size_t numVertices, vector<Vec3i>& welded) {
+    vector<uint32_t> order(numVertices);
+    for (std::size_t v = 0; v < numVertices; v++) order[v] = (uint32_t)v;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        Vec3f p = vertexPosition(positions, stride, a), q = vertexPosition(positions, stride, b);
+        if (p.x != q.x) return p.x < q.x;
+        if (p.y != q.y) return p.y < q.y;
+        return p.z < q.z;
+    });
+    vector<int> canonical(numVertices);
+    for (std::size_t i = 0; i < numVertices; i++) {
+        bool same = i > 0 && vertexPosition(positions, stride, order[i]) == vertexPosition(positions, stride, order[i - 1]);
+        canonical[order[i]] = same ? canonical[order[i - 1]] : (int)order[i];
+    }
+    welded.resize(triangles.size());
+    for (std::size_t t = 0; t < triangles.size(); t++) {
+        welded[t] = Vec3i(canonical[triangles[t][0]], canonical[triangles[t][1]], canonical[triangles[t][2]]);
+    }
+}
+
+// orders the triangles of each meshlet for the vertex cache. a meshlet has at
+// most 64 vertices, they are numbered within the meshlet for the optimizer
+static void optimizeMeshletVertexCache(vector<Vec3i>& triangles, const vector<Meshlet>& meshlets,
+                                       std::size_t numVertices) {
+    vector<int> local(numVertices, -1);
+    vector<int> global;
+    vector<Vec3i> part;
+    for (const Meshlet& meshlet : meshlets) {
+        Vec3i* first = triangles.data() + meshlet.firstTriangle;
+        global.clear();
+        part.clear();
+        for (uint32_t i = 0; i < meshlet.numTriangles; i++) {
+            Vec3i t;
+            for (int k = 0; k < 3; k++) {
+                int v = first[i][k];
+                if (local[v] < 0) {
+                    local[v] = (int)global.size();
+                    global.push_back(v);
+                }
+                t[k] = local[v];
+            }
+            part.push_back(t);
+        }
+        ::optimizeVertexCache(part, global.size());
+        for (uint32_t i = 0; i < meshlet.numTriangles; i++) {
+            for (int k = 0; k < 3; k++) first[i][k] = global[part[i][k]];
+        }
+        for (int v : global) local[v] = -1;
+    }
+}
+
+bool buildMeshlets(vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                   std::size_t numVertices, vector<Meshlet>& meshlets) {
+    meshlets.clear();
+    if (triangles.empty()) return false;
+    // neighbours across seams, the meshlets grow over them too
+    vector<Vec3i> welded;
+    weldPositions(triangles, positions, stride, numVertices, welded);
+    MeshTopology topology;
+    topology.build(welded.data(), welded.size(), numVertices);
+    bool closed = topology.getNumBorderEdges() == 0;
+    vector<Vec3f> normals(triangles.size());
+    for (std::size_t t = 0; t < triangles.size(); t++) normals[t] = unitNormal(positions, stride, triangles[t]);
+
+    vector<unsigned char> used(triangles.size(), 0);
+    // a vertex is in the current meshlet, a triangle a candidate of it, if
+    // its stamp is the meshlet's
+    vector<uint32_t> vertexStamp(numVertices, 0);
+    vector<uint32_t> candidateStamp(triangles.size(), 0);
+    vector<uint32_t> candidates, members;
+    vector<Vec3i> ordered;
+    ordered.reserve(triangles.size());
+    std::size_t seed = 0;
+    uint32_t stamp = 0;
+    while (true) {
+        while (seed < triangles.size() && used[seed]) seed++;
+        if (seed == triangles.size()) break;
+        stamp++;
+        members.clear();
+        candidates.clear();
+        std::size_t numMeshletVertices = 0;
+        Vec3f normalSum;
+        uint32_t t = (uint32_t)seed;
+        while (true) {
+            used[t] = 1;
+            members.push_back(t);
+            normalSum += normals[t];
+            for (int k = 0; k < 3; k++) {
+                int v = triangles[t][k];
+                if (vertexStamp[v] == stamp) continue;
+                vertexStamp[v] = stamp;
+                numMeshletVertices++;
+                for (uint32_t u : topology.vertexTriangles(welded[t][k])) {
+                    if (used[u] || candidateStamp[u] == stamp) continue;
+                    candidateStamp[u] = stamp;
+                    candidates.push_back(u);
+                }
+            }
+            if (members.size() == Meshlet::MAX_TRIANGLES) break;
+
+            Vec3f direction = normalSum.normalized();
+            float bestScore = FLT_MAX;
+            std::size_t best = candidates.size();
+            for (std::size_t i = 0; i < candidates.size();) {
+                uint32_t c = candidates[i];
+                if (used[c]) {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                const Vec3i& triangle = triangles[c];
+                std::size_t added = (vertexStamp[triangle[0]] != stamp) + (vertexStamp[triangle[1]] != stamp) +
+                                    (vertexStamp[triangle[2]] != stamp);
+                if (numMeshletVertices + added <= Meshlet::MAX_VERTICES) {
+                    float score = added + normalWeight * (1.0f - normals[c] * direction);
+                    if (score < bestScore) {
+                        bestScore = score;
+                        best = i;
+                    }
+                }
+                i++;
+            }
+            if (best < candidates.size()) {
+                t = candidates[best];
+                continue;
+            }
+            // no neighbour fits: the next free triangle of the order, which
+            // is close by in a vertex cache order, if it fits
+            while (seed < triangles.size() && used[seed]) seed++;
+            if (seed == triangles.size()) break;
+            const Vec3i& next = triangles[seed];
+            std::size_t added = (vertexStamp[next[0]] != stamp) + (vertexStamp[next[1]] != stamp) +
+                                (vertexStamp[next[2]] != stamp);
+            if (numMeshletVertices + added > Meshlet::MAX_VERTICES) break;
+            t = (uint32_t)seed;
+        }
+
+        Meshlet meshlet = {};
+        meshlet.firstTriangle = (uint32_t)ordered.size();
+        meshlet.numTriangles = (uint32_t)members.size();
+        std::sort(members.begin(), members.end());
+        for (uint32_t m : members) ordered.push_back(triangles[m]);
+        meshlets.push_back(meshlet);
+    }
+    triangles.swap(ordered);
+    optimizeMeshletVertexCache(triangles, meshlets, numVertices);
+    for (Meshlet& meshlet : meshlets) computeMeshletBounds(meshlet, triangles.data(), positions, stride, closed);
+    return closed;
+}
+
+MeshletCulling cullMeshlets(const vector<Meshlet>& meshlets, const ViewState& view, const Frustum& frustum,
+                            vector<uint32_t>& visible) {
+    MeshletCulling culling;
+    bool orthographic = view.isOrthographic();
+    Vec3f eye = view.eyePosition();
+    Vec3f direction = view.viewDirection();
+    for (std::size_t i = 0; i < meshlets.size(); i++) {
+        const Meshlet& m = meshlets[i];
+        if (!frustum.sphereVisible(m.center, m.radius)) {
+            culling.outside++;
+            continue;
+        }
+        // parallel view rays: every point is seen along direction
+        bool backfacing;
+        if (orthographic) {
+            backfacing = direction * m.coneAxis >= m.coneCutoff;
+        }
+        else {
+            Vec3f toCenter = m.center - eye;
+            backfacing = toCenter * m.coneAxis >= m.coneCutoff * toCenter.length() + m.radius * (1.0f + m.coneCutoff);
+        }
+        if (backfacing) {
+            culling.backfacing++;
+            continue;
+        }
+        visible.push_back((uint32_t)i);
+        culling.visible++;
+        culling.visibleTriangles += m.numTriangles;
+    }
+    return culling;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Meshlets: clusters of at most 64 vertices and 124 triangles (the sizes
+// mesh shader hardware is built for) that are culled one by one. Each
+// meshlet is a contiguous range of the triangle array and has a bounding
+// sphere for the view frustum test and a cone bounding its triangle normals
+// for the backface test. The ranges that survive the culling are drawn with
+// one multi draw call.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Vec3.h"
+#include "ViewState.h"
+#include "Frustum.h"
+
+using namespace std;
+
+struct Meshlet {
+    enum { MAX_VERTICES = 64, MAX_TRIANGLES = 124 };
+    uint32_t firstTriangle, numTriangles;
+    // bounding sphere of the vertices
+    Vec3f center;
+    float radius;
+    // all triangles face away from an eye at e if
+    //   (center - e) * coneAxis >= coneCutoff * |center - e| + radius * (1 + coneCutoff),
+    // coneCutoff is the sine of the largest angle between a triangle normal
+    // and coneAxis. a zero axis never culls
+    Vec3f coneAxis;
+    float coneCutoff;
+};
+
+// splits triangles into meshlets and reorders them meshlet by meshlet.
+// positions are the first three floats of each vertex, stride bytes apart.
+// a meshlet starts at the first free triangle of the current order (so an
+// overdraw order survives in the coarse) and grows over shared vertices,
+// preferring triangles that add few vertices and face the way the meshlet
+// does. the growth breaks up a vertex cache order, so the triangles of each
+// meshlet are ordered for the vertex cache again (optimizeVertexCache).
+// the cones are left empty unless the mesh is closed (no border edges once
+// vertices at the same position are merged): back faces of an open mesh can
+// be seen. returns whether it is closed
+bool buildMeshlets(vector<Vec3i>& triangles, const float* positions, std::size_t stride,
+                   std::size_t numVertices, vector<Meshlet>& meshlets);
+
+// sphere and cone of meshlet from its triangles. withCone false leaves the
+// cone empty
+void computeMeshletBounds(Meshlet& meshlet, const Vec3i* triangles, const float* positions, std::size_t stride,
+                          bool withCone);
+
+// what cullMeshlets did in one call
+struct MeshletCulling {
+    MeshletCulling() : visible(0), outside(0), backfacing(0), visibleTriangles(0) {}
+    std::size_t visible;
+    // outside of the view frustum
+    std::size_t outside;
+    // inside, but all triangles face away from the eye
+    std::size_t backfacing;
+    std::size_t visibleTriangles;
+};
+
+// appends the indices of the meshlets that view may see to visible, in order.
+// frustum is the one of view, built once by the caller
+MeshletCulling cullMeshlets(const vector<Meshlet>& meshlets, const ViewState& view, const Frustum& frustum,
+                            vector<uint32_t>& visible);
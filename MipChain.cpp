@@ -0,0 +1,139 @@
+#include "MipChain.h"
+#include "SimdMath.h"
+#include <algorithm>
+#include <cstddef>
+
+// entries of the linear to sRGB table. fine enough that dark values, where
+// sRGB is steepest, still round to the right byte
+static const int encodeSize = 8192;
+
+struct SrgbTables {
+    float decode[256];
+    unsigned char encode[encodeSize];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            decode[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < encodeSize; i++) {
+            float l = i / (float)(encodeSize - 1);
+            float c = l <= 0.0031308f ? 12.92f * l : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+            encode[i] = (unsigned char)(c * 255.0f + 0.5f);
+        }
+    }
+};
+
+static const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+// the channel that is stored linearly, -1 if there is none
+static int alphaChannel(int channels) {
+    return channels == 2 ? 1 : channels == 4 ? 3 : -1;
+}
+
+// 8 bit pixels to linear floats, always four per pixel
+static void decodeRow(const unsigned char* src, int width, int channels, float* dst) {
+    const SrgbTables& tables = srgbTables();
+    int alpha = alphaChannel(channels);
+    for (int x = 0; x < width; x++) {
+        for (int k = 0; k < 4; k++) {
+            float value = 0.0f;
+            if (k == alpha) value = src[k] * (1.0f / 255.0f);
+            else if (k < channels) value = tables.decode[src[k]];
+            dst[k] = value;
+        }
+        src += channels;
+        dst += 4;
+    }
+}
+
+static void encodeRow(const float* src, int width, int channels, unsigned char* dst) {
+    const SrgbTables& tables = srgbTables();
+    int alpha = alphaChannel(channels);
+    float scale[4];
+    for (int k = 0; k < 4; k++) scale[k] = k == alpha ? 255.0f : (float)(encodeSize - 1);
+    for (int x = 0; x < width; x++) {
+        int index[4];
+#ifdef HAVE_SSE2
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        _mm_storeu_si128((__m128i*)index, _mm_cvtps_epi32(_mm_mul_ps(v, _mm_loadu_ps(scale))));
+#else
+        for (int k = 0; k < 4; k++) {
+            index[k] = (int)(std::min(std::max(src[k], 0.0f), 1.0f) * scale[k] + 0.5f);
+        }
+#endif
+        for (int k = 0; k < channels; k++) {
+            dst[k] = k == alpha ? (unsigned char)index[k] : tables.encode[index[k]];
+        }
+        src += 4;
+        dst += channels;
+    }
+}
+
+// one row of the next level from two rows of this one (the same row twice
+// if the level is only one row high)
+static void downsampleRow(const float* row0, const float* row1, int srcWidth, float* dst, int dstWidth) {
+#ifdef HAVE_SSE2
+    const __m128 quarter = _mm_set1_ps(0.25f);
+#endif
+    for (int x = 0; x < dstWidth; x++) {
+        std::size_t a = 8 * (std::size_t)x;
+        std::size_t b = 2 * x + 1 < srcWidth ? a + 4 : a;
+#ifdef HAVE_SSE2
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + a), _mm_loadu_ps(row0 + b)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + a), _mm_loadu_ps(row1 + b)));
+        _mm_storeu_ps(dst + 4 * x, _mm_mul_ps(sum, quarter));
+#else
+        for (int k = 0; k < 4; k++) {
+            dst[4 * x + k] = 0.25f * ((row0[a + k] + row0[b + k]) + (row1[a + k] + row1[b + k]));
+        }
+#endif
+    }
+}
+
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                   vector<MipLevel>& levels) {
+    int w = width, h = height;
+    // the image is converted two rows at a time, the smaller levels are kept
+    // as linear floats so that rounding errors do not add up
+    vector<float> rows(8 * (std::size_t)w);
+    vector<float> current, next;
+    bool fromImage = true;
+    while (w > 1 || h > 1) {
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        next.resize(4 * (std::size_t)nw * nh);
+        for (int y = 0; y < nh; y++) {
+            std::size_t y0 = 2 * (std::size_t)y, y1 = std::min(2 * y + 1, h - 1);
+            const float *row0, *row1;
+            if (fromImage) {
+                decodeRow(pixels + y0 * w * channels, w, channels, rows.data());
+                decodeRow(pixels + y1 * w * channels, w, channels, rows.data() + 4 * w);
+                row0 = rows.data();
+                row1 = rows.data() + 4 * w;
+            }
+            else {
+                row0 = current.data() + 4 * y0 * w;
+                row1 = current.data() + 4 * y1 * w;
+            }
+            downsampleRow(row0, row1, w, next.data() + 4 * (std::size_t)y * nw, nw);
+        }
+
+        MipLevel level;
+        level.width = nw;
+        level.height = nh;
+        level.pixels.resize((std::size_t)nw * nh * channels);
+        for (int y = 0; y < nh; y++) {
+            encodeRow(next.data() + 4 * (std::size_t)y * nw, nw, channels,
+                      level.pixels.data() + (std::size_t)y * nw * channels);
+        }
+        levels.push_back(std::move(level));
+
+        current.swap(next);
+        fromImage = false;
+        w = nw;
+        h = nh;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// Mipmap chains built on the CPU, so the filtering runs on the texture decode
+// workers instead of the GL thread. Each level is a 2x2 box filter of the one
+// above (odd sizes drop their last row/column). Color channels are sRGB and
+// are averaged in linear space, alpha is averaged as is.
+
+#include <vector>
+
+using namespace std;
+
+struct MipLevel {
+    int width, height;
+    vector<unsigned char> pixels;
+};
+
+// appends levels 1 down to 1x1 of the image to levels (level 0 is not copied).
+// channels is 1 (gray), 2 (gray, alpha), 3 (rgb) or 4 (rgba). uses SSE for
+// the filtering
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                   vector<MipLevel>& levels);
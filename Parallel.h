@@ -0,0 +1,28 @@
+#pragma once
+
+// Minimal fork/join helpers on top of std::thread.
+
+#include <thread>
+#include <vector>
+
+// number of threads to use when the caller asks for 0 (= all cores)
+inline unsigned int defaultThreadCount() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// calls fn(i) for every i in [0, count), each on its own thread, and waits
+// for all of them. the calling thread runs i = 0 itself
+template<class Function>
+void parallelFor(unsigned int count, Function fn) {
+    if (count == 0) return;
+    std::vector<std::thread> workers;
+    workers.reserve(count - 1);
+    for (unsigned int i = 1; i < count; i++) {
+        workers.emplace_back(fn, i);
+    }
+    fn(0u);
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
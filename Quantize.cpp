@@ -0,0 +1,110 @@
+#include "Quantize.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint16_t floatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t bits = x & 0x7fffffff;
+    // infinity and nan (keeping it a nan)
+    if (bits >= 0x7f800000) return (uint16_t)(sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0));
+    // 65520 and up round to infinity
+    if (bits >= 0x477ff000) return (uint16_t)(sign | 0x7c00);
+    if (bits < 0x38800000) {
+        // below 2^-14: subnormal half, mantissa * 2^-24
+        if (bits < 0x33000000) return (uint16_t)sign;
+        uint32_t exponent = bits >> 23;
+        uint32_t mantissa = (bits & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (h & 1))) h++;
+        return (uint16_t)(sign | h);
+    }
+    // exponent bias 127 -> 15, a carry of the rounding moves into the exponent
+    uint32_t h = (bits - 0x38000000) >> 13;
+    uint32_t rest = bits & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+    return (uint16_t)(sign | h);
+}
+
+float halfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0) {
+        float value = ldexpf((float)mantissa, -24);
+        return sign ? -value : value;
+    }
+    uint32_t x = exponent == 31 ? sign | 0x7f800000 | (mantissa << 13)
+                                : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static inline float signNotZero(float v) {
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+Vec3f decodeOctahedral(const int8_t code[2]) {
+    float x = std::max(code[0] / 127.0f, -1.0f);
+    float y = std::max(code[1] / 127.0f, -1.0f);
+    Vec3f n(x, y, 1.0f - fabsf(x) - fabsf(y));
+    // lower half: folded over the diagonals
+    if (n.z < 0.0f) {
+        n.x = (1.0f - fabsf(y)) * signNotZero(x);
+        n.y = (1.0f - fabsf(x)) * signNotZero(y);
+    }
+    n.normalize();
+    return n;
+}
+
+void encodeOctahedral(const Vec3f& n, int8_t code[2]) {
+    code[0] = code[1] = 0;
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 == 0.0f) return;
+    float x = n.x / l1;
+    float y = n.y / l1;
+    if (n.z < 0.0f) {
+        float folded = (1.0f - fabsf(y)) * signNotZero(x);
+        y = (1.0f - fabsf(x)) * signNotZero(y);
+        x = folded;
+    }
+    // rounding each coordinate on its own is up to twice as far off
+    Vec3f unit = n / n.length();
+    float baseX = floorf(x * 127.0f);
+    float baseY = floorf(y * 127.0f);
+    float best = -2.0f;
+    for (int i = 0; i < 4; i++) {
+        int8_t candidate[2] = {
+            (int8_t)std::min(std::max(baseX + (i & 1), -127.0f), 127.0f),
+            (int8_t)std::min(std::max(baseY + (i >> 1), -127.0f), 127.0f) };
+        float cosine = decodeOctahedral(candidate) * unit;
+        if (cosine > best) {
+            best = cosine;
+            code[0] = candidate[0];
+            code[1] = candidate[1];
+        }
+    }
+}
+
+PositionQuantization::PositionQuantization(const Vec3f& boundsMin, const Vec3f& boundsMax)
+    : min(boundsMin), extent(boundsMax - boundsMin) {
+}
+
+void PositionQuantization::encode(const Vec3f& p, uint16_t code[3]) const {
+    for (int i = 0; i < 3; i++) {
+        float t = extent[i] > 0.0f ? (p[i] - min[i]) / extent[i] : 0.0f;
+        code[i] = (uint16_t)lrintf(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f);
+    }
+}
+
+Vec3f PositionQuantization::decode(const uint16_t code[3]) const {
+    Vec3f p;
+    for (int i = 0; i < 3; i++) p[i] = min[i] + extent[i] * (code[i] / 65535.0f);
+    return p;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Scalar encodings of the quantized vertex layout (TriangleMesh::QuantizedVertex):
+// positions as unsigned 16 bit fractions of the bounding box, unit normals
+// octahedrally mapped to two signed bytes and texture coordinates as IEEE half
+// floats. Each one decodes as GL reads the attribute, so the draw path uses
+// the data as it is.
+
+#include <cstdint>
+#include "Vec3.h"
+
+using namespace std;
+
+// IEEE 754 binary16. rounds to nearest even, too large values become infinity
+uint16_t floatToHalf(float f);
+float halfToFloat(uint16_t h);
+
+// the code of the four around n that decodes closest to n. a zero vector gets (0, 0)
+void encodeOctahedral(const Vec3f& n, int8_t code[2]);
+// unit vector of code, with the snorm rule of GL 4.2 (c / 127, -128 is -1)
+Vec3f decodeOctahedral(const int8_t code[2]);
+
+// maps the box [min, min + extent] to [0, 65535] per axis. a flat axis
+// (extent 0) encodes as 0
+struct PositionQuantization {
+    Vec3f min, extent;
+
+    PositionQuantization() {}
+    PositionQuantization(const Vec3f& boundsMin, const Vec3f& boundsMax);
+    void encode(const Vec3f& p, uint16_t code[3]) const;
+    Vec3f decode(const uint16_t code[3]) const;
+};
+
+// largest difference between data and its decoded version
+struct QuantizationError {
+    QuantizationError() : position(0.0f), normalDegrees(0.0f), texCoord(0.0f) {}
+    // object space distance
+    float position;
+    // angle between the normals, zero length normals are left out
+    float normalDegrees;
+    // largest difference of u or v
+    float texCoord;
+};
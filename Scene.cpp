@@ -0,0 +1,157 @@
+#include "Scene.h"
+#include "GLStateCache.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+WorldTransform::WorldTransform() {
+    for (int i = 0; i < 16; i++) m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+}
+
+WorldTransform WorldTransform::translation(float x, float y, float z) {
+    WorldTransform transform;
+    transform.m[12] = x;
+    transform.m[13] = y;
+    transform.m[14] = z;
+    return transform;
+}
+
+void WorldTransform::transformBox(const Vec3f& min, const Vec3f& max, Vec3f& outMin, Vec3f& outMax) const {
+    // the center moves, the half extent goes through the absolute values of
+    // the linear part
+    Vec3f center = (min + max) * 0.5f;
+    Vec3f half = (max - min) * 0.5f;
+    for (int row = 0; row < 3; row++) {
+        float c = m[12 + row], h = 0.0f;
+        for (int column = 0; column < 3; column++) {
+            c += m[4 * column + row] * center[column];
+            h += fabsf(m[4 * column + row]) * half[column];
+        }
+        outMin[row] = c - h;
+        outMax[row] = c + h;
+    }
+}
+
+Scene::Scene() : numThreads(1) {
+}
+
+Scene::ObjectId Scene::add(const WorldTransform& transform) {
+    ObjectId id;
+    if (freeIds.empty()) {
+        id = (ObjectId)slots.size();
+        slots.push_back(Slot());
+    }
+    else {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    Slot& slot = slots[id];
+    slot.object.reset(new MeshObject());
+    slot.transform = transform;
+    slot.leaf = -1;
+    pending.push_back(id);
+    return id;
+}
+
+void Scene::remove(ObjectId id) {
+    Slot& slot = slots[id];
+    if (slot.leaf >= 0) hierarchy.remove(slot.leaf);
+    else pending.erase(std::find(pending.begin(), pending.end(), id));
+    slot.object.reset();
+    slot.leaf = -1;
+    freeIds.push_back(id);
+}
+
+MeshObject& Scene::getObject(ObjectId id) {
+    return *slots[id].object;
+}
+
+const WorldTransform& Scene::getTransform(ObjectId id) const {
+    return slots[id].transform;
+}
+
+void Scene::setTransform(ObjectId id, const WorldTransform& transform) {
+    slots[id].transform = transform;
+    refit(id);
+}
+
+void Scene::refit(ObjectId id) {
+    Slot& slot = slots[id];
+    // one without a box goes in with insertCompleted
+    if (slot.leaf < 0) return;
+    Vec3f min, max;
+    if (worldBounds(id, min, max)) {
+        hierarchy.refit(slot.leaf, min, max);
+        return;
+    }
+    hierarchy.remove(slot.leaf);
+    slot.leaf = -1;
+    pending.push_back(id);
+}
+
+bool Scene::worldBounds(ObjectId id, Vec3f& min, Vec3f& max) const {
+    const Slot& slot = slots[id];
+    Vec3f objectMin, objectMax;
+    if (!slot.object->getBounds(objectMin, objectMax)) return false;
+    slot.transform.transformBox(objectMin, objectMax, min, max);
+    return true;
+}
+
+void Scene::insertCompleted() {
+    for (std::size_t i = 0; i < pending.size();) {
+        ObjectId id = pending[i];
+        Vec3f min, max;
+        if (!worldBounds(id, min, max)) {
+            i++;
+            continue;
+        }
+        slots[id].leaf = hierarchy.insert(min, max, id);
+        pending[i] = pending.back();
+        pending.pop_back();
+    }
+}
+
+void Scene::cull(const ViewState& view, vector<ObjectId>& visible) const {
+    hierarchy.cull(Frustum(view), visible, numThreads == 0 ? defaultThreadCount() : numThreads);
+}
+
+void Scene::draw() {
+    insertCompleted();
+    visible.clear();
+    // the camera is read from GL once, each object gets it through its transform
+    ViewState camera = ViewState::current();
+    cull(camera, visible);
+    culling.visible = visible.size() + pending.size();
+    culling.culled = hierarchy.getNumLeaves() - visible.size();
+    visible.insert(visible.end(), pending.begin(), pending.end());
+    for (ObjectId id : visible) {
+        glPushMatrix();
+        glMultMatrixf(slots[id].transform.m);
+        slots[id].object->draw(camera.transformed(slots[id].transform.m), false);
+        glPopMatrix();
+    }
+    GLStateCache::instance().resetBindings();
+}
+
+void Scene::setNumThreads(unsigned int threads) {
+    numThreads = threads;
+}
+
+const FrustumCulling& Scene::getCulling() const {
+    return culling;
+}
+
+bool Scene::isLoading() const {
+    for (const Slot& slot : slots) {
+        if (slot.object && slot.object->isLoading()) return true;
+    }
+    return false;
+}
+
+std::size_t Scene::getNumObjects() const {
+    return slots.size() - freeIds.size();
+}
+
+const DynamicBvh& Scene::getHierarchy() const {
+    return hierarchy;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// Many MeshObjects, each with a world transform, and a DynamicBvh over their
+// boxes in world space. draw walks the hierarchy to find the objects that
+// may be inside the view frustum and draws only those. An object still
+// streamed in has no box yet: it is drawn every frame and goes into the
+// hierarchy once its meshes are complete.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+#include "Vec3.h"
+#include "MeshObject.h"
+#include "DynamicBvh.h"
+#include "Frustum.h"
+#include "ViewState.h"
+
+using namespace std;
+
+// column major 4x4 matrix, as glMultMatrixf takes it
+struct WorldTransform {
+    GLfloat m[16];
+
+    // identity
+    WorldTransform();
+    static WorldTransform translation(float x, float y, float z);
+    // box around the transformed box (min, max)
+    void transformBox(const Vec3f& min, const Vec3f& max, Vec3f& outMin, Vec3f& outMax) const;
+};
+
+class Scene
+{
+public:
+    typedef uint32_t ObjectId;
+
+    Scene();
+
+    // a new, empty object at transform. ids of removed objects are reused
+    ObjectId add(const WorldTransform& transform = WorldTransform());
+    void remove(ObjectId id);
+    // stays valid until the object is removed
+    MeshObject& getObject(ObjectId id);
+    const WorldTransform& getTransform(ObjectId id) const;
+    // moves the object and refits its box in the hierarchy
+    void setTransform(ObjectId id, const WorldTransform& transform);
+    // new box for the object after its meshes changed
+    void refit(ObjectId id);
+
+    // appends the objects in the hierarchy that may be visible from view
+    // (world space), in the order of the hierarchy
+    void cull(const ViewState& view, vector<ObjectId>& visible) const;
+    // culls with the current GL matrices and draws the visible objects and
+    // the ones without a box
+    void draw();
+    // threads of the culling, 0 = one per core (default 1)
+    void setNumThreads(unsigned int threads);
+    // objects drawn and culled by the last draw
+    const FrustumCulling& getCulling() const;
+
+    // true while an object is still streamed in
+    bool isLoading() const;
+    std::size_t getNumObjects() const;
+    const DynamicBvh& getHierarchy() const;
+    // calls fn(MeshObject&) for every object
+    template<class Function>
+    void forEachObject(Function fn) {
+        for (Slot& slot : slots) {
+            if (slot.object) fn(*slot.object);
+        }
+    }
+
+private:
+    struct Slot {
+        unique_ptr<MeshObject> object;
+        WorldTransform transform;
+        // -1 while the object is not in the hierarchy
+        int leaf;
+    };
+
+    // box of the object in world space, false while it has none
+    bool worldBounds(ObjectId id, Vec3f& min, Vec3f& max) const;
+    // objects that got a box since the last call go into the hierarchy
+    void insertCompleted();
+
+    vector<Slot> slots;
+    vector<ObjectId> freeIds;
+    // objects without a box
+    vector<ObjectId> pending;
+    DynamicBvh hierarchy;
+    unsigned int numThreads;
+    FrustumCulling culling;
+    // scratch of draw
+    vector<ObjectId> visible;
+};
@@ -0,0 +1,168 @@
+#include "ShaderRenderer.h"
+#include "GLShader.h"
+#include "GLStateCache.h"
+#include <cmath>
+#include <cstring>
+#include <string>
+
+static_assert(sizeof(FrameUniforms) == 64 + 8 * 16, "FrameUniforms does not match the std140 layout of Frame");
+
+void setModelview(const ShaderProgram& shader, const GLfloat m[16]) {
+    // cofactors of the upper 3x3 (column major, a(r, c) = m[4 * c + r])
+    // over its determinant
+    GLfloat a[3][3];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) a[r][c] = m[4 * c + r];
+    }
+    GLfloat cofactor[3][3];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            int r1 = (r + 1) % 3, r2 = (r + 2) % 3, c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+            cofactor[r][c] = a[r1][c1] * a[r2][c2] - a[r1][c2] * a[r2][c1];
+        }
+    }
+    GLfloat det = a[0][0] * cofactor[0][0] + a[0][1] * cofactor[0][1] + a[0][2] * cofactor[0][2];
+    GLfloat scale = fabsf(det) > 1e-30f ? 1.0f / det : 0.0f;
+    GLfloat normalMatrix[9];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) normalMatrix[3 * c + r] = cofactor[r][c] * scale;
+    }
+    glUniformMatrix4fv(shader.modelview, 1, GL_FALSE, m);
+    glUniformMatrix3fv(shader.normalMatrix, 1, GL_FALSE, normalMatrix);
+}
+
+static const char* frameBlock = R"(
+layout(std140) uniform Frame {
+    mat4 projection;
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+    vec4 sceneAmbient;
+    vec4 materialColor;
+    vec4 materialSpecular;
+    float shininess;
+};
+)";
+
+static const char* vertexShader = R"(
+in vec3 position;
+#ifdef QUANTIZED
+in vec2 normal;
+uniform vec3 boundsMin;
+uniform vec3 boundsExtent;
+
+vec3 decodeOctahedral(vec2 o) {
+    vec3 n = vec3(o, 1.0 - abs(o.x) - abs(o.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(o.yx)) * vec2(o.x >= 0.0 ? 1.0 : -1.0, o.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+#else
+in vec3 normal;
+#endif
+in vec2 texCoord;
+uniform mat4 modelview;
+// inverse transpose of the upper 3x3 of modelview
+uniform mat3 normalMatrix;
+out vec3 eyePosition;
+out vec3 eyeNormal;
+out vec2 uv;
+
+void main() {
+#ifdef QUANTIZED
+    vec4 p = vec4(boundsMin + boundsExtent * position, 1.0);
+    vec3 n = decodeOctahedral(normal);
+#else
+    vec4 p = vec4(position, 1.0);
+    vec3 n = normal;
+#endif
+    vec4 eye = modelview * p;
+    eyePosition = eye.xyz;
+    eyeNormal = normalMatrix * n;
+    uv = texCoord;
+    gl_Position = projection * eye;
+}
+)";
+
+static const char* fragmentShader = R"(
+in vec3 eyePosition;
+in vec3 eyeNormal;
+in vec2 uv;
+uniform sampler2D colorTexture;
+// false without a texture, the fixed function pipeline does not texture then
+uniform bool textured;
+out vec4 fragColor;
+
+void main() {
+    vec3 n = normalize(eyeNormal);
+    vec3 l = normalize(lightPosition.w == 0.0 ? lightPosition.xyz : lightPosition.xyz - eyePosition);
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = 0.0;
+    // the non local viewer looks along -z
+    if (diffuse > 0.0) specular = pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), shininess);
+    vec3 color = materialColor.rgb * (sceneAmbient.rgb + lightAmbient.rgb + lightDiffuse.rgb * diffuse)
+               + materialSpecular.rgb * lightSpecular.rgb * specular;
+    vec4 lit = vec4(min(color, vec3(1.0)), materialColor.a);
+    fragColor = textured ? lit * texture(colorTexture, uv) : lit;
+}
+)";
+
+static ShaderProgram buildShaderProgram(bool quantized) {
+    ShaderProgram shader = { 0, -1, -1, -1, -1, -1, -1 };
+    string header = string("#version 330 core\n") + (quantized ? "#define QUANTIZED\n" : "") + frameBlock;
+    string vertexSource = header + vertexShader;
+    string fragmentSource = header + fragmentShader;
+    shader.program = buildProgram(quantized ? "shaded quantized" : "shaded", vertexSource.c_str(),
+                                  fragmentSource.c_str(), { "position", "normal", "texCoord" });
+    if (!shader.program) return shader;
+    glUniformBlockBinding(shader.program, glGetUniformBlockIndex(shader.program, "Frame"), 0);
+    shader.modelview = glGetUniformLocation(shader.program, "modelview");
+    shader.normalMatrix = glGetUniformLocation(shader.program, "normalMatrix");
+    shader.colorTexture = glGetUniformLocation(shader.program, "colorTexture");
+    shader.textured = glGetUniformLocation(shader.program, "textured");
+    shader.boundsMin = glGetUniformLocation(shader.program, "boundsMin");
+    shader.boundsExtent = glGetUniformLocation(shader.program, "boundsExtent");
+    return shader;
+}
+
+const ShaderProgram& shaderProgram(bool quantized) {
+    static ShaderProgram shaders[2];
+    static bool built[2] = { false, false };
+    if (!built[quantized]) {
+        shaders[quantized] = buildShaderProgram(quantized);
+        built[quantized] = true;
+    }
+    return shaders[quantized];
+}
+
+void setFrameUniforms(const FrameUniforms& uniforms) {
+    static GLuint buffer = 0;
+    static FrameUniforms last;
+    if (buffer == 0) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &uniforms, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        last = uniforms;
+    }
+    else if (memcmp(&last, &uniforms, sizeof(FrameUniforms)) != 0) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &uniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        last = uniforms;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, buffer);
+}
+
+void frameLighting(GLfloat lightPosition[4], GLfloat color[4]) {
+    static GLfloat lastPosition[4], lastColor[4];
+    static std::size_t lastFrame = 0;
+    std::size_t frame = GLStateCache::instance().frameNumber();
+    if (frame == 0 || frame != lastFrame) {
+        glGetLightfv(GL_LIGHT0, GL_POSITION, lastPosition);
+        glGetFloatv(GL_CURRENT_COLOR, lastColor);
+        lastFrame = frame;
+    }
+    memcpy(lightPosition, lastPosition, sizeof(lastPosition));
+    memcpy(color, lastColor, sizeof(lastColor));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Programmable draw path of TriangleMesh (drawMode 3): GLSL 3.30 core
+// shaders on vertex array objects, with projection, light and material in
+// one std140 uniform block that changes once per frame, and the modelview
+// of each mesh in plain uniforms. Lights per pixel (Blinn-Phong) with the terms the
+// fixed function pipeline uses for draw_settings: one point light, ambient
+// and diffuse from the material color, a non local viewer and the texture
+// modulating the lit color. Needs GL 3.3 and glewInit.
+
+#include <GL/glew.h>
+
+using namespace std;
+
+// the uniform block Frame of the shaders, std140 layout
+struct FrameUniforms {
+    GLfloat projection[16];
+    // eye space
+    GLfloat lightPosition[4];
+    GLfloat lightAmbient[4];
+    GLfloat lightDiffuse[4];
+    GLfloat lightSpecular[4];
+    // GL_LIGHT_MODEL_AMBIENT
+    GLfloat sceneAmbient[4];
+    // ambient and diffuse, as glColor with GL_COLOR_MATERIAL
+    GLfloat materialColor[4];
+    GLfloat materialSpecular[4];
+    GLfloat shininess;
+    GLfloat padding[3];
+};
+
+// attribute 0 is the position, 1 the normal and 2 the texture coordinates
+struct ShaderProgram {
+    GLuint program;
+    GLint modelview, normalMatrix, colorTexture, textured, boundsMin, boundsExtent;
+};
+
+// the program for float vertices or for the quantized layout (unorm16
+// positions in boundsMin + boundsExtent * p, octahedral normals), shared by
+// all meshes and built on first use. program stays 0 if that fails
+const ShaderProgram& shaderProgram(bool quantized);
+
+// binds the uniform block buffer to the Frame block and uploads uniforms if
+// they differ from the last ones
+void setFrameUniforms(const FrameUniforms& uniforms);
+
+// the position of GL_LIGHT0 (eye space) and the current color, the parts of
+// the Frame block the app sets through GL. read from GL on the first call
+// in a frame of GLStateCache::beginFrame, on every call while no frame began
+void frameLighting(GLfloat lightPosition[4], GLfloat color[4]);
+
+// sets the modelview matrix of shader, which has to be in use, and the
+// inverse transpose of its upper 3x3 for the normals
+void setModelview(const ShaderProgram& shader, const GLfloat modelview[16]);
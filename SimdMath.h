@@ -0,0 +1,46 @@
+#pragma once
+
+// SSE helpers shared by the vectorized kernels. Every kernel has a scalar
+// fallback for targets without SSE2 (HAVE_SSE2 not defined).
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef HAVE_SSE2
+
+// tan of four floats, |x| < pi/2. Cephes tanf: reduction to [-pi/4, pi/4]
+// in three steps and a degree 13 polynomial, max. error about 2 ulp
+inline __m128 tan_ps(__m128 x) {
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+    __m128 sign = _mm_and_ps(x, signMask);
+    x = _mm_andnot_ps(signMask, x);
+
+    // j = nearest even multiple of pi/4
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(j);
+    __m128 z = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+    z = _mm_sub_ps(z, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+    z = _mm_sub_ps(z, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+
+    __m128 zz = _mm_mul_ps(z, z);
+    __m128 p = _mm_set1_ps(9.38540185543e-3f);
+    p = _mm_add_ps(_mm_mul_ps(p, zz), _mm_set1_ps(3.11992232697e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, zz), _mm_set1_ps(2.44301354525e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, zz), _mm_set1_ps(5.34112807005e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, zz), _mm_set1_ps(1.33387994085e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, zz), _mm_set1_ps(3.33331568548e-1f));
+    p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, zz), z), z);
+
+    // odd multiples of pi/2 away: tan(x) = -1 / tan(z)
+    __m128 cot = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(-1.0f), p);
+    p = _mm_or_ps(_mm_and_ps(cot, inverse), _mm_andnot_ps(cot, p));
+    return _mm_xor_ps(p, sign);
+}
+
+#endif
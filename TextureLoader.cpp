@@ -0,0 +1,224 @@
+#include "TextureLoader.h"
+#include "Parallel.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include "GLStateCache.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+
+Texture::Texture()
+    : id(0), ready(false), failed(false) {
+}
+
+Texture::~Texture() {
+    // borrowed ids belong to the original
+    if (ready && !original) TextureLoader::instance().release(id);
+}
+
+TextureLoader& TextureLoader::instance() {
+    static TextureLoader* loader = new TextureLoader();
+    return *loader;
+}
+
+TextureLoader::TextureLoader()
+    : decoding(0), placeholderID(0) {
+}
+
+void TextureLoader::startWorkers() {
+    // leave one core for the GL thread. the workers run until the process ends
+    unsigned int n = std::max(1u, std::min(4u, defaultThreadCount() - 1));
+    for (unsigned int i = 0; i < n; i++) {
+        workers.emplace_back(&TextureLoader::work, this);
+    }
+}
+
+shared_ptr<Texture> TextureLoader::findContent(uint64_t hash, const shared_ptr<Texture>& texture) {
+    map<uint64_t, weak_ptr<Texture>>::iterator it = byContent.find(hash);
+    if (it != byContent.end()) {
+        shared_ptr<Texture> original = it->second.lock();
+        if (original) return original;
+    }
+    byContent[hash] = texture;
+    return nullptr;
+}
+
+void TextureLoader::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeUp.wait(lock, [this] { return !jobs.empty(); });
+        Image image;
+        image.texture = jobs.front();
+        image.pixels = nullptr;
+        jobs.pop_front();
+        decoding++;
+        lock.unlock();
+
+        MappedFile file;
+        if (file.open(image.texture->filename.c_str()) && file.size() > 0) {
+            // identical files share one GL texture and are decoded only once
+            uint64_t hash = hashBytes(file.data(), file.size());
+            lock.lock();
+            image.original = findContent(hash, image.texture);
+            lock.unlock();
+            if (!image.original) {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                image.pixels = stbi_load_from_memory((const stbi_uc*)file.data(), (int)file.size(),
+                                                     &image.width, &image.height, &image.channels, 0);
+                if (!image.pixels) {
+                    cout << "Failed to load texture " << image.texture->filename << ": " << stbi_failure_reason() << endl;
+                }
+                else {
+                    chrono::steady_clock::time_point decoded = chrono::steady_clock::now();
+                    buildMipChain(image.pixels, image.width, image.height, image.channels, image.mips);
+                    chrono::steady_clock::time_point filtered = chrono::steady_clock::now();
+                    cout << "Texture " << image.texture->filename << " (" << image.width << "x" << image.height
+                         << "): decoded in " << chrono::duration<double, std::milli>(decoded - start).count()
+                         << " ms, " << image.mips.size() << " mip levels in "
+                         << chrono::duration<double, std::milli>(filtered - decoded).count() << " ms" << endl;
+                }
+            }
+        }
+        else {
+            cout << "Failed to load texture " << image.texture->filename << ": can not open file" << endl;
+        }
+
+        lock.lock();
+        decoding--;
+        decoded.push_back(std::move(image));
+    }
+}
+
+void TextureLoader::release(GLuint id) {
+    std::lock_guard<std::mutex> lock(releasedMutex);
+    released.push_back(id);
+}
+
+GLuint TextureLoader::placeholder() {
+    if (placeholderID == 0) {
+        // light gray, so untextured meshes still show their shading
+        const unsigned char gray[4] = { 200, 200, 200, 255 };
+        glGenTextures(1, &placeholderID);
+        GLStateCache::instance().bindTexture(placeholderID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+        GLStateCache::instance().bindTexture(0);
+    }
+    return placeholderID;
+}
+
+shared_ptr<Texture> TextureLoader::load(const char* filename) {
+    std::error_code error;
+    string path = std::filesystem::weakly_canonical(std::filesystem::path(filename), error).string();
+    if (error) path = filename;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // already requested: no decode, no new GL texture
+    map<string, weak_ptr<Texture>>::iterator it = byPath.find(path);
+    if (it != byPath.end()) {
+        shared_ptr<Texture> texture = it->second.lock();
+        if (texture) return texture;
+    }
+    shared_ptr<Texture> texture = make_shared<Texture>();
+    texture->id = placeholder();
+    texture->filename = path;
+    byPath[path] = texture;
+    if (workers.empty()) startWorkers();
+    jobs.push_back(texture);
+    wakeUp.notify_one();
+    return texture;
+}
+
+// pixel format of an image with channels components
+static GLenum channelFormat(int channels) {
+    switch (channels) {
+    case 1: return GL_LUMINANCE;
+    case 2: return GL_LUMINANCE_ALPHA;
+    case 3: return GL_RGB;
+    default: return GL_RGBA;
+    }
+}
+
+static GLint channelInternalFormat(int channels) {
+    switch (channels) {
+    case 1: return GL_LUMINANCE8;
+    case 2: return GL_LUMINANCE8_ALPHA8;
+    case 3: return GL_RGB8;
+    default: return GL_RGBA8;
+    }
+}
+
+void TextureLoader::uploadPending(double budgetMs) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(releasedMutex);
+        if (!released.empty()) GLStateCache::instance().deleteTextures((GLsizei)released.size(), released.data());
+        released.clear();
+    }
+    // copies of textures whose original is not uploaded yet
+    vector<Image> waiting;
+    while (true) {
+        Image image;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (decoded.empty()) break;
+            image = std::move(decoded.front());
+            decoded.pop_front();
+        }
+        if (image.original) {
+            if (!image.original->ready && !image.original->failed) {
+                waiting.push_back(std::move(image));
+                continue;
+            }
+            image.texture->id = image.original->id;
+            image.texture->ready = image.original->ready;
+            image.texture->failed = image.original->failed;
+            image.texture->original = image.original;
+            continue;
+        }
+        if (!image.pixels) {
+            image.texture->failed = true;
+            continue;
+        }
+        GLuint id;
+        glGenTextures(1, &id);
+        GLStateCache::instance().bindTexture(id);
+        // set the texture wrapping/filtering options (on the currently bound texture object)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // rows of 1 and 3 channel images are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, channelInternalFormat(image.channels), image.width, image.height, 0,
+                     channelFormat(image.channels), GL_UNSIGNED_BYTE, image.pixels);
+        for (std::size_t level = 0; level < image.mips.size(); level++) {
+            const MipLevel& mip = image.mips[level];
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level + 1, channelInternalFormat(image.channels), mip.width, mip.height, 0,
+                         channelFormat(image.channels), GL_UNSIGNED_BYTE, mip.pixels.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        GLStateCache::instance().bindTexture(0);
+        stbi_image_free(image.pixels);
+        image.texture->id = id;
+        image.texture->ready = true;
+
+        double ms = chrono::duration<double, std::milli>(chrono::steady_clock::now() - start).count();
+        if (ms >= budgetMs) break;
+    }
+    if (!waiting.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.insert(decoded.end(), waiting.begin(), waiting.end());
+    }
+}
+
+bool TextureLoader::isBusy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !jobs.empty() || !decoded.empty() || decoding > 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Asynchronous, shared texture loading. Image files are decoded by a pool of
+// worker threads, which also build the mipmap chain. The GL thread uploads
+// the results in small portions per frame (uploadPending). Until its upload a texture shows a placeholder.
+// Textures are shared: requesting the same file again returns the same
+// Texture, and files with identical content share one GL texture. The GL
+// texture is deleted when the last handle to it is released.
+
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MipChain.h"
+
+using namespace std;
+
+// a texture as used by the meshes. id is the placeholder texture until the
+// image is uploaded. id and ready are only touched on the GL thread
+struct Texture {
+    Texture();
+    ~Texture();
+
+    GLuint id;
+    bool ready;
+    // decoding failed, the placeholder stays
+    bool failed;
+    // canonical path
+    string filename;
+    // set if an earlier texture has the same content, id is borrowed from it
+    shared_ptr<Texture> original;
+};
+
+class TextureLoader
+{
+public:
+    // the loader lives until the process ends, so textures can be released
+    // from any destructor
+    static TextureLoader& instance();
+
+    // returns the texture of filename, queuing it for decoding if it is not
+    // loaded yet. has to be called on the GL thread
+    shared_ptr<Texture> load(const char* filename);
+
+    // uploads decoded images until budgetMs milliseconds are used up (but at
+    // least one) and deletes released textures. call once per frame on the GL thread
+    void uploadPending(double budgetMs);
+
+    // true while images are decoded or waiting for their upload
+    bool isBusy();
+
+private:
+    TextureLoader();
+    TextureLoader(const TextureLoader&);
+    TextureLoader& operator=(const TextureLoader&);
+
+    // a decoded image on its way to the GL thread. without pixels either
+    // original is set (same content) or decoding failed
+    struct Image {
+        shared_ptr<Texture> texture;
+        shared_ptr<Texture> original;
+        unsigned char* pixels;
+        int width, height, channels;
+        // levels 1 and smaller
+        vector<MipLevel> mips;
+    };
+
+    friend struct Texture;
+    // called when a texture owning a GL texture is destroyed
+    void release(GLuint id);
+
+    void startWorkers();
+    void work();
+    // finds or registers the texture with this content hash
+    shared_ptr<Texture> findContent(uint64_t hash, const shared_ptr<Texture>& texture);
+    GLuint placeholder();
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    // textures to decode, decoded images to upload (guarded by mutex)
+    deque<shared_ptr<Texture>> jobs;
+    deque<Image> decoded;
+    // jobs taken by a worker but not in decoded yet
+    int decoding;
+    vector<std::thread> workers;
+    // live textures by canonical path and by content hash (guarded by mutex)
+    map<string, weak_ptr<Texture>> byPath;
+    map<uint64_t, weak_ptr<Texture>> byContent;
+    // GL textures to delete on the GL thread. own mutex, textures may die
+    // while mutex is held
+    std::mutex releasedMutex;
+    vector<GLuint> released;
+    GLuint placeholderID;
+};
@@ -11,15 +11,47 @@
 // ========================================================================== //
 
 #include <iostream>
-#include <fstream>
 #include <float.h>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 // #include <GL/glut.h>
 #include "TriangleMesh.h"
+#include "MappedFile.h"
+#include "MeshParser.h"
+#include "MeshCache.h"
+#include "FastParse.h"
+#include "Parallel.h"
+#include "LaserScan.h"
+#include "MeshStream.h"
+#include "TextureLoader.h"
+#include "VertexLayout.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ViewState.h"
+#include "GLShader.h"
+#include "ShaderRenderer.h"
+#include "GLStateCache.h"
+#include "Frustum.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+// the buffer objects of a mesh, created on the GL thread by the first
+// drawBuffers or drawShaded and deleted with the last copy of the mesh using them
+struct MeshBuffers {
+    MeshBuffers() : vertexArray(0) {
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+    }
+    ~MeshBuffers() {
+        GLuint names[2] = { vertexBuffer, indexBuffer };
+        GLStateCache::instance().deleteBuffers(2, names);
+        if (vertexArray) GLStateCache::instance().deleteVertexArrays(1, &vertexArray);
+    }
+    GLuint vertexBuffer, indexBuffer;
+    // of drawShaded, 0 until it first runs (GL 3.0)
+    GLuint vertexArray;
+};
 
-#include <cassert>
 
 
 // ===============================
@@ -45,36 +77,149 @@ TriangleMesh::TriangleMesh() {
     shininess = 128.0f;
     specularLightMaterial = { 1.0f, 1.0f, 1.0f, 1.0f };
     shininessMaterial = 128.0f;
-    drawMode = 1;
+    drawMode = 2;
+    weldVertices = true;
+    useMeshCache = true;
+    optimizeOnLoad = true;
+    buildLodsOnLoad = false;
+    buildMeshletsOnLoad = true;
+    lodThreshold = 1.0f;
+    frustumCulling = true;
+    drawView = nullptr;
+    drawFrustum = nullptr;
+    interleaved = false;
+    quantize = false;
 }
 
 TriangleMesh::~TriangleMesh() {
   clear();
 }
 
-void TriangleMesh::calculateNormals() {
-  normals.resize(vertices.size());
-  // TODO: calculate normals for each vertex
-  for (Triangle const& t : triangles) {
-      // retrieve immutable references to each vertex of the triangle
-      Vec3f const& p1 = vertices[t[0]];
-      Vec3f const& p2 = vertices[t[1]];
-      Vec3f const& p3 = vertices[t[2]];
+void TriangleMesh::calculateNormals(unsigned int numThreads) {
+  // adds to the normals already there (OBJ file normals)
+  if (packed.empty()) normals.resize(vertices.size());
+  std::size_t numVertices = getNumVertices();
+  if (topologyThreadCount(triangles.size(), numThreads) == 1) {
+      if (!packed.empty()) accumulateNormals(PackedLayout(packed.data()), triangles.data(), triangles.size(), numVertices);
+      else accumulateNormals(SeparateLayout(vertices.data(), normals.data(), textures.data()),
+                             triangles.data(), triangles.size(), numVertices);
+      return;
+  }
+  // gathered per vertex, same result
+  if (!topology.isBuiltFor(triangles.data(), triangles.size(), numVertices)) {
+      topology.build(triangles.data(), triangles.size(), numVertices, numThreads);
+  }
+  if (!packed.empty()) accumulateNormals(PackedLayout(packed.data()), triangles.data(), topology, numThreads);
+  else accumulateNormals(SeparateLayout(vertices.data(), normals.data(), textures.data()),
+                         triangles.data(), topology, numThreads);
+}
+
+void TriangleMesh::calculateBounds() {
+  if (!packed.empty()) computeBounds(PackedLayout(packed.data()), packed.size(), boundsMin, boundsMax);
+  else computeBounds(SeparateLayout(vertices.data(), normals.data(), textures.data()), vertices.size(), boundsMin, boundsMax);
+  calculateBoundingSphere();
+}
+
+void TriangleMesh::calculateBoundingSphere() {
+  if (!packed.empty()) computeBoundingSphere(PackedLayout(packed.data()), packed.size(), boundsMin, boundsMax,
+                                             boundsCenter, boundsRadius);
+  else computeBoundingSphere(SeparateLayout(vertices.data(), normals.data(), textures.data()), vertices.size(),
+                             boundsMin, boundsMax, boundsCenter, boundsRadius);
+}
+
+void TriangleMesh::finishLoad(const char* filename) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (optimizeOnLoad) {
+      optimizeVertexCache();
+      optimizeOverdraw();
+  }
+  // the meshlets keep the coarse order, the vertex fetch order follows theirs
+  if (buildMeshletsOnLoad) buildMeshlets();
+  if (optimizeOnLoad) optimizeVertexFetch();
+  if (buildLodsOnLoad) buildLods();
+  if (interleaved && packed.empty()) packVertices();
+  invalidateTopology();
+  calculateBounds();
+  if (useMeshCache) saveCache(filename);
+  if (quantize) quantizeVertices();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << "finishLoad: " << filename << ": passes after the parse in " << seconds * 1000.0 << " ms" << endl;
+}
 
-      const Vec3f edge1 = p1 - p2;
-      const Vec3f edge2 = p1 - p3;
+void TriangleMesh::packVertices() {
+  packedTextures = textures.size() == vertices.size();
+  packed.resize(vertices.size());
+  for (std::size_t i = 0; i < packed.size(); i++) {
+      packed[i].position = vertices[i];
+      packed[i].normal = i < normals.size() ? normals[i] : Normal();
+      if (packedTextures) packed[i].tex = textures[i];
+  }
+  Vertices().swap(vertices);
+  Normals().swap(normals);
+  Textures().swap(textures);
+  vertexBufferCurrent = false;
+}
 
-      const Vec3f normal = edge1 ^ edge2;
-      normals[t[0]] += normal;
-      normals[t[1]] += normal;
-      normals[t[2]] += normal;
+void TriangleMesh::unpackVertices() {
+  vertices.resize(packed.size());
+  normals.resize(packed.size());
+  textures.resize(packedTextures ? packed.size() : 0);
+  for (std::size_t i = 0; i < packed.size(); i++) {
+      vertices[i] = packed[i].position;
+      normals[i] = packed[i].normal;
+      if (packedTextures) textures[i] = packed[i].tex;
   }
+  PackedVertices().swap(packed);
+  vertexBufferCurrent = false;
+}
+
+void TriangleMesh::quantizeVertices() {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  std::size_t numVertices = getNumVertices();
+  std::size_t bytes = getVertexBytes();
+  // the exact box, bounds only grow with edits
+  Vec3f min, max;
+  bool isPacked = !packed.empty();
+  if (!isPacked && normals.size() < vertices.size()) normals.resize(vertices.size());
+  SeparateLayout separate(vertices.data(), normals.data(), textures.data());
+  if (isPacked) computeBounds(PackedLayout(packed.data()), numVertices, min, max);
+  else computeBounds(separate, numVertices, min, max);
+  quantizedBox = PositionQuantization(min, max);
+  quantizedTextures = isPacked ? packedTextures : textures.size() == vertices.size();
+  quantized.resize(numVertices);
+  if (isPacked) quantizationError = ::quantizeVertices(PackedLayout(packed.data()), numVertices, quantizedTextures,
+                                                       quantizedBox, quantized.data());
+  else quantizationError = ::quantizeVertices(separate, numVertices, quantizedTextures, quantizedBox, quantized.data());
+  Vertices().swap(vertices);
+  Normals().swap(normals);
+  Textures().swap(textures);
+  PackedVertices().swap(packed);
+  vertexBufferCurrent = false;
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  float diagonal = (max - min).length();
+  cout << "quantizeVertices: " << numVertices << " vertices, " << bytes << " -> " << getVertexBytes()
+       << " bytes, max. error position " << quantizationError.position << " ("
+       << (diagonal > 0.0f ? quantizationError.position / diagonal : 0.0f) << " of the diagonal), normal "
+       << quantizationError.normalDegrees << " degrees, texture coordinates " << quantizationError.texCoord
+       << " in " << seconds * 1000.0 << " ms" << endl;
+}
+
+void TriangleMesh::dequantizeVertices() {
+  if (quantized.empty()) return;
+  std::size_t numVertices = quantized.size();
+  vertices.resize(numVertices);
+  normals.resize(numVertices);
+  textures.resize(quantizedTextures ? numVertices : 0);
+  ::dequantizeVertices(quantized.data(), numVertices, quantizedTextures, quantizedBox,
+                       SeparateLayout(vertices.data(), normals.data(), textures.data()));
+  QuantizedVertices().swap(quantized);
+  vertexBufferCurrent = false;
+  if (interleaved) packVertices();
+}
 
-  // normalize normals
-  for (Normals::iterator nit=normals.begin(); nit!=normals.end(); ++nit) {
-     //the normalize() function returns a boolean which can be used if you want to check for erroneous normals
-	 (*nit).normalize();
-   }
+unsigned int TriangleMesh::cacheFlags() const {
+  return (weldVertices ? 1u : 0u) | (optimizeOnLoad ? 2u : 0u) | (buildLodsOnLoad ? 4u : 0u) |
+         (buildMeshletsOnLoad ? 8u : 0u);
 }
 
 void TriangleMesh::clear() {
@@ -82,6 +227,26 @@ void TriangleMesh::clear() {
   vertices.clear();
   triangles.clear();
   normals.clear();
+  textures.clear();
+  packed.clear();
+  packedTextures = false;
+  quantized.clear();
+  quantizedTextures = false;
+  quantizationError = QuantizationError();
+  lods.clear();
+  currentLod = 0;
+  meshlets.clear();
+  meshletCones = false;
+  meshletCulling = MeshletCulling();
+  vertexBufferCurrent = false;
+  invalidateTopology();
+  dirtyVertices.clear();
+  dirtyMark.clear();
+  boundsMin.clear();
+  boundsMax.clear();
+  boundsCenter.clear();
+  boundsRadius = 0.0f;
+  stream.reset();
 }
 
 // ================
@@ -99,10 +264,122 @@ vector<Vec3f>& TriangleMesh::getNormals() {
   return normals;
 }
 
+TriangleMesh::PackedVertices& TriangleMesh::getPackedVertices() {
+  return packed;
+}
+
+TriangleMesh::QuantizedVertices& TriangleMesh::getQuantizedVertices() {
+  return quantized;
+}
+
+std::size_t TriangleMesh::getNumVertices() const {
+  if (!quantized.empty()) return quantized.size();
+  return packed.empty() ? vertices.size() : packed.size();
+}
+
+std::size_t TriangleMesh::getVertexBytes() const {
+  std::size_t bytes = 0;
+  for (std::size_t stride : vertexStrides()) bytes += stride * getNumVertices();
+  return bytes;
+}
+
+const MeshTopology& TriangleMesh::getTopology() {
+  if (!topology.isBuiltFor(triangles.data(), triangles.size(), getNumVertices())) {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      vector<Vec3f>().swap(faceNormals);
+      topology.build(triangles.data(), triangles.size(), getNumVertices(), 0);
+      double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      cout << "getTopology: " << triangles.size() << " triangles in " << seconds * 1000.0 << " ms, "
+           << (triangles.empty() ? 0.0 : (double)topology.memoryBytes() / triangles.size()) << " bytes per triangle, "
+           << topology.getNumBorderEdges() << " border and " << topology.getNumNonManifoldEdges()
+           << " non manifold half edges" << endl;
+  }
+  return topology;
+}
+
+void TriangleMesh::invalidateTopology() {
+  topology.clear();
+  vector<Vec3f>().swap(faceNormals);
+  indexBufferCurrent = false;
+}
+
+void TriangleMesh::setVertexPosition(std::size_t v, const Vertex& p) {
+  dequantizeVertices();
+  if (packed.empty()) vertices[v] = p;
+  else packed[v].position = p;
+  markDirty(v, v + 1);
+}
+
+void TriangleMesh::markDirty(std::size_t first, std::size_t last) {
+  dequantizeVertices();
+  if (dirtyMark.size() < getNumVertices()) dirtyMark.resize(getNumVertices(), 0);
+  vertexBufferCurrent = false;
+  for (std::size_t v = first; v < last; v++) {
+      if (dirtyMark[v]) continue;
+      dirtyMark[v] = 1;
+      dirtyVertices.push_back((uint32_t)v);
+  }
+}
+
+std::size_t TriangleMesh::updateNormals() {
+  if (dirtyVertices.empty()) return 0;
+  std::size_t numVertices = getNumVertices();
+  if (packed.empty()) normals.resize(numVertices);
+  getTopology();
+  if (faceNormals.size() != triangles.size()) {
+      if (!packed.empty()) computeFaceNormals(PackedLayout(packed.data()), triangles.data(), triangles.size(), faceNormals);
+      else computeFaceNormals(SeparateLayout(vertices.data(), normals.data(), textures.data()),
+                              triangles.data(), triangles.size(), faceNormals);
+  }
+  // the marks of markDirty are the scratch marks of updateNormals, all zero
+  // again afterwards
+  vector<uint32_t> updated;
+  if (!packed.empty()) ::updateNormals(PackedLayout(packed.data()), triangles.data(), topology, faceNormals,
+                                       dirtyVertices, dirtyMark, updated);
+  else ::updateNormals(SeparateLayout(vertices.data(), normals.data(), textures.data()), triangles.data(), topology,
+                       faceNormals, dirtyVertices, dirtyMark, updated);
+  refitMeshlets(dirtyVertices);
+  vertexBufferCurrent = false;
+  for (uint32_t v : dirtyVertices) {
+      const Vertex& p = packed.empty() ? vertices[v] : packed[v].position;
+      for (int i = 0; i < 3; i++) {
+          boundsMin[i] = std::min(boundsMin[i], p[i]);
+          boundsMax[i] = std::max(boundsMax[i], p[i]);
+      }
+      // keeps its center, still around all vertices
+      boundsRadius = std::max(boundsRadius, (p - boundsCenter).length());
+  }
+  dirtyVertices.clear();
+  return updated.size();
+}
+
+void TriangleMesh::refitMeshlets(const vector<uint32_t>& moved) {
+  if (meshlets.empty()) return;
+  // meshlets are in triangle order, the one of triangle t is the last starting at or before it
+  vector<unsigned char> touched(meshlets.size(), 0);
+  for (uint32_t v : moved) {
+      for (uint32_t t : topology.vertexTriangles(v)) {
+          vector<Meshlet>::const_iterator it = std::upper_bound(meshlets.begin(), meshlets.end(), t,
+              [](uint32_t triangle, const Meshlet& m) { return triangle < m.firstTriangle; });
+          touched[it - meshlets.begin() - 1] = 1;
+      }
+  }
+  std::size_t stride;
+  const float* positions = positionData(stride);
+  for (std::size_t i = 0; i < meshlets.size(); i++) {
+      if (touched[i]) computeMeshletBounds(meshlets[i], triangles.data(), positions, stride, meshletCones);
+  }
+}
+
 void TriangleMesh::flipNormals() {
+  dequantizeVertices();
   for (Normals::iterator it = normals.begin(); it != normals.end(); ++it) {
     (*it) *= -1.0;
   }
+  for (PackedVertices::iterator it = packed.begin(); it != packed.end(); ++it) {
+    (*it).normal *= -1.0;
+  }
+  vertexBufferCurrent = false;
 }
 
 void TriangleMesh::setPosition(float x, float y, float z) {
@@ -111,301 +388,1203 @@ void TriangleMesh::setPosition(float x, float y, float z) {
     position.z = z;
 }
 
+const Vec3f& TriangleMesh::getPosition() const {
+    return position;
+}
+
+void TriangleMesh::setWeldVertices(bool weld) {
+    weldVertices = weld;
+}
+
+void TriangleMesh::setUseMeshCache(bool use) {
+    useMeshCache = use;
+}
+
+void TriangleMesh::setOptimizeOnLoad(bool optimize) {
+    optimizeOnLoad = optimize;
+}
+
+void TriangleMesh::setBuildLods(bool build) {
+    buildLodsOnLoad = build;
+}
+
+void TriangleMesh::setBuildMeshlets(bool build) {
+    buildMeshletsOnLoad = build;
+}
+
+void TriangleMesh::setLodThreshold(float pixels) {
+    lodThreshold = pixels;
+}
+
+void TriangleMesh::setFrustumCulling(bool cull) {
+    frustumCulling = cull;
+}
+
+void TriangleMesh::setInterleaved(bool interleave) {
+    interleaved = interleave;
+    // a running stream fills the separate arrays, takeLoaded converts them
+    if (stream) return;
+    if (interleaved && packed.empty() && !vertices.empty()) packVertices();
+    else if (!interleaved && !packed.empty()) unpackVertices();
+}
+
+bool TriangleMesh::isInterleaved() const {
+    return interleaved;
+}
+
+void TriangleMesh::setQuantized(bool quantizeVertices) {
+    quantize = quantizeVertices;
+    // takeLoaded converts a running stream
+    if (stream) return;
+    if (quantize && quantized.empty() && getNumVertices() > 0) this->quantizeVertices();
+    else if (!quantize) dequantizeVertices();
+}
+
+bool TriangleMesh::isQuantized() const {
+    return quantize;
+}
+
+const QuantizationError& TriangleMesh::getQuantizationError() const {
+    return quantizationError;
+}
+
+const Vec3f& TriangleMesh::getBoundsMin() const {
+    return boundsMin;
+}
+
+const Vec3f& TriangleMesh::getBoundsMax() const {
+    return boundsMax;
+}
+
+const Vec3f& TriangleMesh::getBoundsCenter() const {
+    return boundsCenter;
+}
+
+float TriangleMesh::getBoundsRadius() const {
+    return boundsRadius;
+}
+
 void TriangleMesh::switchDrawMode()
 {
     drawMode += 1;
-    if (drawMode >= 2)
+    if (drawMode >= 4)
     {
         drawMode = 0;
     }
-    std::cout << "drawMode switched to " << drawMode << std::endl;
+    const char* names[] = { "immediate mode", "vertex arrays", "buffer objects", "shaders" };
+    std::cout << "drawMode switched to " << drawMode << " (" << names[drawMode] << ")" << std::endl;
+}
+
+void TriangleMesh::setDrawMode(unsigned int mode) {
+    drawMode = std::min(mode, 3u);
 }
 
 // =================
 // === LOAD MESH ===
 // =================
 
-void TriangleMesh::loadLSA(const char* filename) {  
-  std::ifstream in(filename);
-  if (!in.is_open()) {
+// small files are not worth a thread
+static const std::size_t minChunkSize = 256 * 1024;
+
+// number of chunks to split size bytes into for numThreads threads (0 = one per core)
+static unsigned int chunkCount(std::size_t size, unsigned int numThreads) {
+    if (numThreads == 0) numThreads = defaultThreadCount();
+    return (unsigned int)std::max<std::size_t>(1, std::min<std::size_t>(numThreads, size / minChunkSize));
+}
+
+// splits the body of an OFF or LSA file into chunks and numbers their data lines
+static void splitIndexedBody(const char* body, const char* end, unsigned int numThreads, vector<IndexedChunk>& chunks) {
+    vector<const char*> bounds;
+    splitLines(body, end, chunkCount(end - body, numThreads), bounds);
+    chunks.resize(bounds.size() - 1);
+    vector<std::size_t> numLines(chunks.size());
+    parallelFor((unsigned int)chunks.size(), [&](unsigned int i) {
+        chunks[i].begin = bounds[i];
+        chunks[i].end = bounds[i + 1];
+        numLines[i] = countDataLines(bounds[i], bounds[i + 1]);
+    });
+    std::size_t line = 0;
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        chunks[i].firstLine = line;
+        line += numLines[i];
+    }
+}
+
+// concatenates the triangles of all chunks in file order
+static void mergeIndexedTriangles(vector<IndexedChunk>& chunks, vector<Vec3i>& triangles) {
+    vector<std::size_t> first(chunks.size() + 1, 0);
+    std::size_t numBadFaces = 0;
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        first[i + 1] = first[i] + chunks[i].triangles.size();
+        numBadFaces += chunks[i].numBadFaces;
+    }
+    triangles.resize(first[chunks.size()]);
+    parallelFor((unsigned int)chunks.size(), [&](unsigned int i) {
+        std::copy(chunks[i].triangles.begin(), chunks[i].triangles.end(), triangles.begin() + first[i]);
+        vector<Vec3i>().swap(chunks[i].triangles);
+    });
+    if (numBadFaces > 0) cout << "skipped " << numBadFaces << " invalid faces" << endl;
+}
+
+void TriangleMesh::loadLSA(const char* filename, unsigned int numThreads) {
+  if (useMeshCache && loadCache(filename)) return;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  MappedFile file;
+  if (!file.open(filename)) {
     cout << "loadLSA: can not open " << filename << endl;
     return;
   }
-  char s[256];
-  in >> s;
   // first word: LSA
-  if (!(s[0] == 'L' && s[1] == 'S' && s[2] == 'A')) return;
   // get number of vertices nv, faces nf, edges ne and baseline distance
   int nv, nf, ne;
   float baseline;
-  in >> nv;
-  in >> nf;
-  in >> ne;
-  in >> baseline;
-  if (nv <= 0 || nf <= 0) return;
+  const char* body = parseIndexedHeader(file.data(), file.end(), "LSA", nv, nf, ne, &baseline);
+  if (body == nullptr || nv <= 0 || nf <= 0) return;
   // clear any existing mesh
   clear();
-  // read vertices  
+  // stage one: read alpha, beta, gamma of all vertices into separate arrays
+  // and all triangles
+  vector<float> alpha(nv), beta(nv), gamma(nv);
+  vector<IndexedChunk> chunks;
+  splitIndexedBody(body, file.end(), numThreads, chunks);
+  parallelFor((unsigned int)chunks.size(), [&](unsigned int i) {
+      parseIndexedChunk(chunks[i], nv, nf, [&](std::size_t line, float a, float b, float g) {
+          alpha[line] = a;
+          beta[line] = b;
+          gamma[line] = g;
+      });
+  });
+  mergeIndexedTriangles(chunks, triangles);
+  // stage two: calculate the vertex coordinates in blocks
   vertices.resize(nv);
-  // TODO: read alpha, beta, gamma for each vertex and calculate verticex coordinates
+  unsigned int numBlocks = (unsigned int)chunks.size();
+  parallelFor(numBlocks, [&](unsigned int i) {
+      std::size_t first = (std::size_t)nv * i / numBlocks;
+      std::size_t last = (std::size_t)nv * (i + 1) / numBlocks;
+      laserScanToCartesian(&alpha[first], &beta[first], &gamma[first], last - first, baseline, &vertices[first]);
+  });
+  if (interleaved) packVertices();
 
-// read triangles
-triangles.resize(nf);
-// TODO: read all triangles from the file
+  // calculate normals
+  calculateNormals(numThreads);
 
-// calculate normals
-calculateNormals();
+  // the parse alone, finishLoad reports its passes
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  double mb = file.size() / (1024.0 * 1024.0);
+  cout << "loadLSA: " << filename << ": " << triangles.size() << " triangles, " << mb << " MB in "
+       << seconds * 1000.0 << " ms (" << mb / seconds << " MB/s, " << chunks.size() << " threads)" << endl;
+  finishLoad(filename);
 }
 
-void TriangleMesh::loadOFF(const char* filename) {
-    std::ifstream in(filename);
-    if (!in.is_open()) {
+void TriangleMesh::loadOFF(const char* filename, unsigned int numThreads) {
+    if (useMeshCache && loadCache(filename)) return;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(filename)) {
         cout << "loadOFF: can not find " << filename << endl;
         return;
     }
-    char s[256];
-    in >> s;
     // first word: OFF
-    if (!(s[0] == 'O' && s[1] == 'F' && s[2] == 'F')) return;
-    // get number of vertices nv, faces nf, edges ne and baseline distance
+    // get number of vertices nv, faces nf, edges ne
     int nv, nf, ne;
-    in >> nv;
-    in >> nf;
-    in >> ne;
-    if (nv <= 0 || nf <= 0) return;
+    const char* body = parseIndexedHeader(file.data(), file.end(), "OFF", nv, nf, ne, nullptr);
+    if (body == nullptr || nv <= 0 || nf <= 0) return;
     // clear any existing mesh
     clear();
-    // read vertices  
-    vertices.resize(nv);
-    // TODO: read all vertices from the file
-    float vx, vy, vz;
-    for (std::size_t i = 0; i < nv; i++) {
-        in >> vx;
-        in >> vy;
-        in >> vz;
-        vertices[i] = Vec3f(vx, vy, vz);
-        //vertices.push_back(Vertex{ vx, vy, vz }); // store them in vector
-    }
-
-    // read triangles
-    triangles.resize(nf);
-    // TODO: read triangles from the file
-    int num_vert;
-    for (std::size_t i = 0; i < nf; i++) {
-        in >> num_vert;
-        assert(num_vert == 3);
-
-        in >> vx;
-        in >> vy;
-        in >> vz;
-        triangles[i] = Vec3i(vx, vy, vz);
+
+    // the body is split into chunks at line boundaries. counting the data
+    // lines of each chunk first tells where its vertices and faces belong
+    vector<IndexedChunk> chunks;
+    splitIndexedBody(body, file.end(), numThreads, chunks);
+    if (interleaved) {
+        packed.resize(nv);
+        parallelFor((unsigned int)chunks.size(), [&](unsigned int i) {
+            parseIndexedChunk(chunks[i], nv, nf, [&](std::size_t line, float x, float y, float z) {
+                packed[line].position = Vec3f(x, y, z);
+            });
+        });
+    }
+    else {
+        vertices.resize(nv);
+        parallelFor((unsigned int)chunks.size(), [&](unsigned int i) {
+            parseIndexedChunk(chunks[i], nv, nf, [&](std::size_t line, float x, float y, float z) {
+                vertices[line] = Vec3f(x, y, z);
+            });
+        });
     }
+    mergeIndexedTriangles(chunks, triangles);
 
     // calculate normals
-    calculateNormals();
+    calculateNormals(numThreads);
+
+    // the parse alone, finishLoad reports its passes
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mb = file.size() / (1024.0 * 1024.0);
+    cout << "loadOFF: " << filename << ": " << triangles.size() << " triangles, " << mb << " MB in "
+         << seconds * 1000.0 << " ms (" << mb / seconds << " MB/s, " << chunks.size() << " threads)" << endl;
+    finishLoad(filename);
 }
 
-void TriangleMesh::loadOBJ(const char* filename) {
-    // Storing the local possible texture coordinates
-    /*struct Tex2D
-    {
-        float u, v;
-    };*/
-    vector<Tex2D> localTexCoords;
-    vector<Vec3f> localVertices;
-    vector<Vec3f> localNormals;
-	
-    std::ifstream in(filename);
-    if (!in.is_open()) {
+// looks up an OBJ attribute. missing or out of range indices give a zero value
+template<class T>
+static inline T objAttribute(const vector<T>& list, int index) {
+    if (index < 0 || index >= (int)list.size()) return T();
+    return list[index];
+}
+
+void TriangleMesh::loadOBJ(const char* filename, unsigned int numThreads) {
+    if (useMeshCache && loadCache(filename)) return;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(filename)) {
         std::cout << "loadOBJ: can not find " << filename << endl;
         return;
     }
-    while (in) {
-        string block;
-        in >> block;
-        if (block == "v") {
-            // vertices.resize(vertices.size() + 1);
-            float vx, vy, vz;
-            in >> vx;
-            in >> vy;
-            in >> vz;
-            localVertices.push_back(Vertex{ vx,vy,vz });
-            //localVertices.emplace_back(Vertex{ vx,vy,vz });
-            
-            //std::cout << "vertex detected" << endl;
+    // split the file at line boundaries
+    vector<const char*> bounds;
+    splitLines(file.data(), file.end(), chunkCount(file.size(), numThreads), bounds);
+    std::size_t numChunks = bounds.size() - 1;
+
+    vector<ObjChunk> chunks(numChunks);
+    parallelFor((unsigned int)numChunks, [&](unsigned int i) {
+        parseOBJ(bounds[i], bounds[i + 1], chunks[i]);
+    });
+
+    // prefix sums of the element counts give the global index of the first
+    // element of each chunk (needed for relative indices) and the place of
+    // its corners in the output arrays
+    vector<std::size_t> positionBase(numChunks + 1, 0), normalBase(numChunks + 1, 0);
+    vector<std::size_t> texCoordBase(numChunks + 1, 0), cornerBase(numChunks + 1, 0);
+    for (std::size_t i = 0; i < numChunks; i++) {
+        positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+        normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+        texCoordBase[i + 1] = texCoordBase[i] + chunks[i].texCoords.size();
+        cornerBase[i + 1] = cornerBase[i] + chunks[i].corners.size();
+    }
+
+    // faces may reference elements of any chunk, so merge the attribute lists first
+    vector<Vec3f> positions, fileNormals;
+    vector<Tex2D> texCoords;
+    if (numChunks == 1) {
+        positions.swap(chunks[0].positions);
+        fileNormals.swap(chunks[0].normals);
+        texCoords.swap(chunks[0].texCoords);
+    }
+    else {
+        positions.resize(positionBase[numChunks]);
+        fileNormals.resize(normalBase[numChunks]);
+        texCoords.resize(texCoordBase[numChunks]);
+        parallelFor((unsigned int)numChunks, [&](unsigned int i) {
+            std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), positions.begin() + positionBase[i]);
+            std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), fileNormals.begin() + normalBase[i]);
+            std::copy(chunks[i].texCoords.begin(), chunks[i].texCoords.end(), texCoords.begin() + texCoordBase[i]);
+        });
+    }
+
+    // make all corner indices global, out of range ones become -1
+    std::size_t nc = cornerBase[numChunks];
+    vector<ObjCorner> corners(nc);
+    parallelFor((unsigned int)numChunks, [&](unsigned int chunk) {
+        vector<ObjCorner>& local = chunks[chunk].corners;
+        std::size_t first = cornerBase[chunk];
+        for (std::size_t i = 0; i < local.size(); i++) {
+            ObjCorner c = local[i];
+            if (c.relative & ObjCorner::RELATIVE_V) c.v += (int)positionBase[chunk];
+            if (c.relative & ObjCorner::RELATIVE_VN) c.vn += (int)normalBase[chunk];
+            if (c.relative & ObjCorner::RELATIVE_VT) c.vt += (int)texCoordBase[chunk];
+            clampOBJCorner(c, (int)positions.size(), (int)texCoords.size(), (int)fileNormals.size());
+            corners[first + i] = c;
+        }
+        vector<ObjCorner>().swap(local);
+    });
+
+    // clear any existing mesh
+    clear();
+    // vertex i gets the attributes of corner c, in the layout the mesh uses
+    auto setVertex = [&](std::size_t i, const ObjCorner& c) {
+        if (interleaved) {
+            packed[i].position = objAttribute(positions, c.v);
+            packed[i].normal = objAttribute(fileNormals, c.vn);
+            packed[i].tex = objAttribute(texCoords, c.vt);
+        }
+        else {
+            vertices[i] = objAttribute(positions, c.v);
+            normals[i] = objAttribute(fileNormals, c.vn);
+            textures[i] = objAttribute(texCoords, c.vt);
         }
-        else if (block == "vn") {
-            float nx, ny, nz;
-            in >> nx;
-            in >> ny;
-            in >> nz;
-            localNormals.push_back(Vertex{ nx,ny,nz });
-            //vertices.push_back(Vertex{ nx,ny,nz });
-            // muss berarbeitet werden
+    };
+    auto resizeVertices = [&](std::size_t n) {
+        if (interleaved) {
+            packed.resize(n);
+            packedTextures = true;
         }
-        else if (block == "vt") {
-            float u, v;
-            in >> u;
-            in >> v;
-            localTexCoords.push_back(Tex2D{ u,v });
-            //textures.push_back({ u, v });
+        else {
+            vertices.resize(n);
+            normals.resize(n);
+            textures.resize(n);
         }
-        else if (block == "f") {
-            //string v1, v2, v3, vt1, vt2, vt3, vn1, vn2, vn3;
-            string v1, v2, v3, vt1, vt2, vt3, vn1, vn2, vn3;// v4, vt4, vn4;
-            //in >> block;
-            //char  s[256];
-            //std::stringstream ss(block);
-            std::getline(in, v1, '/');
-            std::getline(in, vt1, '/');
-            std::getline(in, vn1, ' ');
-
-            std::getline(in, v2, '/');
-            std::getline(in, vt2, '/');
-            std::getline(in, vn2, ' ');
-
-            std::getline(in, v3, '/');
-            std::getline(in, vt3, '/');
-            std::getline(in, vn3);
-
-            //std::getline(in, v4, '/');
-            //std::getline(in, vt4, '/');
-            //std::getline(in, vn4);
-        	
-            vertices.push_back(localVertices[std::stoi(v1) - 1]);
-            vertices.push_back(localVertices[std::stoi(v2) - 1]);
-            vertices.push_back(localVertices[std::stoi(v3) - 1]);
-            normals.push_back(localNormals[std::stoi(vn1) - 1]);
-            normals.push_back(localNormals[std::stoi(vn2) - 1]);
-            normals.push_back(localNormals[std::stoi(vn3) - 1]);
-        	
-            textures.push_back(localTexCoords[std::stoi(vt1) - 1]);
-            textures.push_back(localTexCoords[std::stoi(vt2) - 1]);
-            textures.push_back(localTexCoords[std::stoi(vt3) - 1]);
-        	
-            //triangles.push_back(Triangle{ std::stoi(v1) - 1,std::stoi(v2) - 1,std::stoi(v3) - 1 });
-            triangles.push_back(Triangle{ (int)vertices.size() - 3, (int)vertices.size() - 2, (int)vertices.size() - 1 });
-
-        	//triTextures.push_back(Vec3i{ std::stoi(vt1) - 1,std::stoi(vt2) - 1,std::stoi(vt3) - 1 });
-            
-            //triangles.push_back(Triangle{ std::stoi(v3) - 1,std::stoi(v4) - 1,std::stoi(v1) - 1 });
-            //in >> s;
-            
+    };
+    if (weldVertices) {
+        // one vertex per distinct (v, vt, vn) combination
+        vector<ObjCorner> unique;
+        vector<int> indices;
+        weldOBJCorners(corners, unique, indices);
+        resizeVertices(unique.size());
+        for (std::size_t i = 0; i < unique.size(); i++) {
+            setVertex(i, unique[i]);
         }
+        triangles.resize(nc / 3);
+        for (std::size_t i = 0; i < triangles.size(); i++) {
+            triangles[i] = Triangle(indices[3 * i], indices[3 * i + 1], indices[3 * i + 2]);
+        }
+        cout << "loadOBJ: welded " << nc << " corners to " << unique.size() << " vertices ("
+             << (unique.empty() ? 0.0 : (double)nc / unique.size()) << "x fewer)" << endl;
+    }
+    else {
+        // every corner gets its own vertex, normal and texture coordinate
+        resizeVertices(nc);
+        triangles.resize(nc / 3);
+        parallelFor((unsigned int)numChunks, [&](unsigned int chunk) {
+            for (std::size_t i = cornerBase[chunk]; i < cornerBase[chunk + 1]; i++) {
+                setVertex(i, corners[i]);
+            }
+            for (std::size_t i = cornerBase[chunk] / 3; i < cornerBase[chunk + 1] / 3; i++) {
+                triangles[i] = Triangle((int)(3 * i), (int)(3 * i + 1), (int)(3 * i + 2));
+            }
+        });
     }
+    calculateNormals(numThreads);
+
+    // the parse alone, finishLoad reports its passes
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mb = file.size() / (1024.0 * 1024.0);
+    cout << "loadOBJ: " << filename << ": " << triangles.size() << " triangles, " << mb << " MB in "
+         << seconds * 1000.0 << " ms (" << mb / seconds << " MB/s, " << numChunks << " threads)" << endl;
+    finishLoad(filename);
+}
+
+void TriangleMesh::loadStreaming(const char* filename) {
+    if (useMeshCache && loadCache(filename)) return;
+    clear();
+    stream = make_shared<MeshStream>();
+    stream->filename = filename;
+    stream->weldVertices = weldVertices;
+    stream->start = chrono::steady_clock::now();
+    TriangleMesh* result = new TriangleMesh();
+    result->useMeshCache = useMeshCache;
+    result->optimizeOnLoad = optimizeOnLoad;
+    result->buildLodsOnLoad = buildLodsOnLoad;
+    result->buildMeshletsOnLoad = buildMeshletsOnLoad;
+    result->interleaved = interleaved;
+    result->quantize = quantize;
+    stream->result.reset(result);
+    startMeshStream(stream);
+}
+
+bool TriangleMesh::updateStream() {
+    if (!stream) return false;
+    Vertices newVertices;
+    Normals newNormals;
+    Textures newTextures;
+    Triangles newTriangles;
+    bool done, failed;
+    {
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        done = stream->done;
+        failed = stream->failed;
+        if (!done) {
+            newVertices.swap(stream->vertices);
+            newNormals.swap(stream->normals);
+            newTextures.swap(stream->textures);
+            newTriangles.swap(stream->triangles);
+        }
+    }
+    if (done) {
+        // the thread has the whole mesh with all passes done, the pieces
+        // shown so far go
+        shared_ptr<MeshStream> finished = stream;
+        stream.reset();
+        if (failed) clear();
+        else takeLoaded(*finished->result);
+        return false;
+    }
+    // new vertices first, the new triangles may use them
+    std::size_t first = vertices.size();
+    vertices.insert(vertices.end(), newVertices.begin(), newVertices.end());
+    textures.insert(textures.end(), newTextures.begin(), newTextures.end());
+    vector<Vec3f>& sums = stream->normalSums;
+    sums.insert(sums.end(), newNormals.begin(), newNormals.end());
+    sums.resize(vertices.size());
+    normals.resize(vertices.size());
+    for (std::size_t i = first; i < vertices.size(); i++) {
+        normals[i] = sums[i].normalized();
+    }
+    // accumulate in the same order as calculateNormals, so the final normals match it exactly
+    for (Triangle const& t : newTriangles) {
+        const Vec3f normal = faceNormal(SeparateLayout(vertices.data(), nullptr, nullptr), t);
+        sums[t[0]] += normal;
+        sums[t[1]] += normal;
+        sums[t[2]] += normal;
+        for (int k = 0; k < 3; k++) normals[t[k]] = sums[t[k]].normalized();
+    }
+    triangles.insert(triangles.end(), newTriangles.begin(), newTriangles.end());
+    vertexBufferCurrent = false;
+    invalidateTopology();
+    return true;
+}
+
+void TriangleMesh::finishStreamedLoad(Vertices& allVertices, Normals& fileNormals, Textures& allTextures,
+                                      Triangles& allTriangles, const char* filename) {
+    clear();
+    vertices.swap(allVertices);
+    normals.swap(fileNormals);
+    textures.swap(allTextures);
+    triangles.swap(allTriangles);
+    // the file normals plus the face normals, as the render thread summed them
     calculateNormals();
+    finishLoad(filename);
+}
+
+void TriangleMesh::takeLoaded(TriangleMesh& loaded) {
+    vertices.swap(loaded.vertices);
+    normals.swap(loaded.normals);
+    textures.swap(loaded.textures);
+    triangles.swap(loaded.triangles);
+    packed.swap(loaded.packed);
+    packedTextures = loaded.packedTextures;
+    quantized.swap(loaded.quantized);
+    quantizedTextures = loaded.quantizedTextures;
+    quantizedBox = loaded.quantizedBox;
+    quantizationError = loaded.quantizationError;
+    lods.swap(loaded.lods);
+    currentLod = 0;
+    meshlets.swap(loaded.meshlets);
+    meshletCones = loaded.meshletCones;
+    meshletCulling = MeshletCulling();
+    boundsMin = loaded.boundsMin;
+    boundsMax = loaded.boundsMax;
+    boundsCenter = loaded.boundsCenter;
+    boundsRadius = loaded.boundsRadius;
+    dirtyVertices.clear();
+    dirtyMark.clear();
+    vertexBufferCurrent = false;
+    invalidateTopology();
+    // the layout may have been switched while the load ran
+    setQuantized(quantize);
+    setInterleaved(interleaved);
+}
+
+bool TriangleMesh::isLoading() const {
+    return stream != nullptr;
+}
+
+bool TriangleMesh::loadCache(const char* filename) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    MappedFile file;
+    MeshCacheData data;
+    if (!MeshCache::read(filename, cacheFlags(), file, data)) return false;
+    clear();
+    if (interleaved) {
+        packed.resize(data.numVertices);
+        packedTextures = data.numTextures == data.numVertices;
+        for (std::size_t i = 0; i < packed.size(); i++) {
+            packed[i].position = data.vertices[i];
+            if (i < data.numNormals) packed[i].normal = data.normals[i];
+            if (packedTextures) packed[i].tex = data.textures[i];
+        }
+    }
+    else {
+        vertices.assign(data.vertices, data.vertices + data.numVertices);
+        normals.assign(data.normals, data.normals + data.numNormals);
+        textures.assign(data.textures, data.textures + data.numTextures);
+    }
+    triangles.assign(data.triangles, data.triangles + data.numTriangles);
+    const Vec3i* lodTriangles = data.lodTriangles;
+    lods.resize(data.numLods);
+    for (std::size_t i = 0; i < lods.size(); i++) {
+        lods[i].triangles.assign(lodTriangles, lodTriangles + data.lodTriangleCounts[i]);
+        lods[i].error = data.lodErrors[i];
+        lodTriangles += data.lodTriangleCounts[i];
+    }
+    meshlets.assign(data.meshlets, data.meshlets + data.numMeshlets);
+    for (const Meshlet& m : meshlets) meshletCones = meshletCones || m.coneAxis != Vec3f();
+    boundsMin = data.boundsMin;
+    boundsMax = data.boundsMax;
+    calculateBoundingSphere();
+    if (quantize) quantizeVertices();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "loadCache: " << MeshCache::pathFor(filename) << ": " << triangles.size() << " triangles in "
+         << seconds * 1000.0 << " ms" << endl;
+    return true;
+}
+
+bool TriangleMesh::saveCache(const char* filename) {
+    // the decoded data would be taken for the full precision one
+    if (!quantized.empty()) {
+        cout << "saveCache: " << filename << ": quantized meshes are not cached" << endl;
+        return false;
+    }
+    // the cache stores separate arrays
+    Vertices packedVertices;
+    Normals packedNormals;
+    Textures packedTexCoords;
+    for (std::size_t i = 0; i < packed.size(); i++) {
+        packedVertices.push_back(packed[i].position);
+        packedNormals.push_back(packed[i].normal);
+        if (packedTextures) packedTexCoords.push_back(packed[i].tex);
+    }
+    const Vertices& v = packed.empty() ? vertices : packedVertices;
+    const Normals& n = packed.empty() ? normals : packedNormals;
+    const Textures& t = packed.empty() ? textures : packedTexCoords;
+    MeshCacheData data;
+    data.vertices = v.data();
+    data.normals = n.data();
+    data.textures = t.data();
+    data.triangles = triangles.data();
+    data.numVertices = v.size();
+    data.numNormals = n.size();
+    data.numTextures = t.size();
+    data.numTriangles = triangles.size();
+    data.boundsMin = boundsMin;
+    data.boundsMax = boundsMax;
+    // levels of detail in one array
+    Triangles lodTriangles;
+    data.numLods = std::min<std::size_t>(lods.size(), MeshCacheHeader::MAX_LODS);
+    for (std::size_t i = 0; i < data.numLods; i++) {
+        lodTriangles.insert(lodTriangles.end(), lods[i].triangles.begin(), lods[i].triangles.end());
+        data.lodTriangleCounts[i] = lods[i].triangles.size();
+        data.lodErrors[i] = lods[i].error;
+    }
+    data.lodTriangles = lodTriangles.data();
+    data.meshlets = meshlets.data();
+    data.numMeshlets = meshlets.size();
+    return MeshCache::write(filename, cacheFlags(), data);
 }
 
 void TriangleMesh::loadTexture(const char* filename) {
-    //unsigned int texture;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    // set the texture wrapping/filtering options (on the currently bound texture object)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load and generate the texture
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        //glGenerateMipmap(GL_TEXTURE_2D);
+    // decoded in the background, shows a placeholder until it is uploaded
+    texture = TextureLoader::instance().load(filename);
+}
+
+// ====================
+// === OPTIMIZATION ===
+// ====================
+
+void TriangleMesh::optimizeVertexCache() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    VertexCacheStats before = analyzeVertexCache(triangles, getNumVertices());
+    ::optimizeVertexCache(triangles, getNumVertices());
+    meshlets.clear();
+    invalidateTopology();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    VertexCacheStats after = analyzeVertexCache(triangles, getNumVertices());
+    cout << "optimizeVertexCache: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+         << " -> " << after.atvr << " (16 entry FIFO) in " << seconds * 1000.0 << " ms" << endl;
+}
+
+vector<std::size_t> TriangleMesh::vertexStrides() const {
+    vector<std::size_t> strides;
+    if (!quantized.empty()) {
+        strides.push_back(sizeof(QuantizedVertex));
+        return strides;
     }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
+    if (!packed.empty()) {
+        strides.push_back(sizeof(PackedVertex));
+        return strides;
+    }
+    strides.push_back(sizeof(Vertex));
+    strides.push_back(sizeof(Normal));
+    if (textures.size() == vertices.size()) strides.push_back(sizeof(Tex2D));
+    return strides;
+}
+
+const float* TriangleMesh::positionData(std::size_t& stride) const {
+    if (!packed.empty()) {
+        stride = sizeof(PackedVertex);
+        return &packed[0].position.x;
+    }
+    stride = sizeof(Vertex);
+    return vertices.empty() ? nullptr : &vertices[0].x;
+}
+
+vector<const char*> TriangleMesh::vertexPointers(bool buffered) const {
+    vector<const char*> pointers;
+    if (!quantized.empty()) pointers.push_back((const char*)quantized.data());
+    else if (!packed.empty()) pointers.push_back((const char*)packed.data());
+    else {
+        pointers.push_back((const char*)vertices.data());
+        pointers.push_back((const char*)normals.data());
+        if (textures.size() == vertices.size()) pointers.push_back((const char*)textures.data());
+    }
+    if (!buffered) return pointers;
+    vector<std::size_t> strides = vertexStrides();
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < pointers.size(); i++) {
+        pointers[i] = reinterpret_cast<const char*>(offset);
+        offset += strides[i] * getNumVertices();
     }
-    stbi_image_free(data);
+    return pointers;
+}
+
+void TriangleMesh::uploadBuffers() {
+    if (buffers && vertexBufferCurrent && indexBufferCurrent) return;
+    // a copy still draws the old data
+    if (!buffers || buffers.use_count() > 1) {
+        buffers = make_shared<MeshBuffers>();
+        vertexBufferCurrent = indexBufferCurrent = false;
+    }
+    GLStateCache& state = GLStateCache::instance();
+    // the element buffer binding would go into a bound vertex array object
+    state.bindVertexArray(0);
+    if (!vertexBufferCurrent) {
+        // the layout may have changed
+        vertexArrayCurrent = false;
+        vector<std::size_t> strides = vertexStrides();
+        vector<const char*> arrays = vertexPointers(false);
+        state.bindBuffer(GL_ARRAY_BUFFER, buffers->vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, getVertexBytes(), nullptr, GL_STATIC_DRAW);
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < arrays.size(); i++) {
+            glBufferSubData(GL_ARRAY_BUFFER, offset, strides[i] * getNumVertices(), arrays[i]);
+            offset += strides[i] * getNumVertices();
+        }
+        vertexBufferCurrent = true;
+    }
+    if (!indexBufferCurrent) {
+        std::size_t numTriangles = triangles.size();
+        for (const Lod& lod : lods) numTriangles += lod.triangles.size();
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numTriangles * sizeof(Triangle), nullptr, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, triangles.size() * sizeof(Triangle), triangles.data());
+        std::size_t offset = triangles.size() * sizeof(Triangle);
+        for (const Lod& lod : lods) {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, lod.triangles.size() * sizeof(Triangle),
+                            lod.triangles.data());
+            offset += lod.triangles.size() * sizeof(Triangle);
+        }
+        indexBufferCurrent = true;
+    }
+}
+
+void TriangleMesh::optimizeOverdraw(float threshold) {
+    dequantizeVertices();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    VertexCacheStats before = analyzeVertexCache(triangles, getNumVertices());
+    std::size_t stride;
+    const float* positions = positionData(stride);
+    std::size_t numClusters = ::optimizeOverdraw(triangles, positions, stride, getNumVertices(), threshold);
+    meshlets.clear();
+    invalidateTopology();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    VertexCacheStats after = analyzeVertexCache(triangles, getNumVertices());
+    cout << "optimizeOverdraw: " << numClusters << " clusters, ACMR " << before.acmr << " -> " << after.acmr
+         << " in " << seconds * 1000.0 << " ms" << endl;
+}
+
+// moves element i of data to remap[i]. arrays of another length (no
+// texture coordinates) stay as they are
+template<class T, class A>
+static void remapVertexArray(vector<T, A>& data, const vector<int>& remap) {
+    if (data.size() != remap.size()) return;
+    vector<T, A> remapped(data.size());
+    for (std::size_t i = 0; i < data.size(); i++) remapped[remap[i]] = data[i];
+    data.swap(remapped);
+}
+
+void TriangleMesh::optimizeVertexFetch() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    std::size_t numVertices = getNumVertices();
+    vector<std::size_t> strides = vertexStrides();
+    std::size_t before = analyzeVertexFetch(triangles, numVertices, strides);
+    vector<int> remap;
+    ::optimizeVertexFetch(triangles, numVertices, remap);
+    remapVertexArray(vertices, remap);
+    remapVertexArray(normals, remap);
+    remapVertexArray(textures, remap);
+    remapVertexArray(packed, remap);
+    remapVertexArray(quantized, remap);
+    for (Lod& lod : lods) {
+        for (Triangle& t : lod.triangles) t = Triangle(remap[t[0]], remap[t[1]], remap[t[2]]);
+    }
+    // pending edits move with their vertices
+    if (!dirtyMark.empty()) dirtyMark.resize(numVertices, 0);
+    remapVertexArray(dirtyMark, remap);
+    for (uint32_t& v : dirtyVertices) v = (uint32_t)remap[v];
+    vertexBufferCurrent = false;
+    invalidateTopology();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    std::size_t after = analyzeVertexFetch(triangles, numVertices, strides);
+    std::size_t bytes = 0;
+    for (std::size_t stride : strides) bytes += numVertices * stride;
+    cout << "optimizeVertexFetch: " << before << " -> " << after << " cache lines per draw ("
+         << (bytes == 0 ? 0.0 : after * 64.0 / bytes) << "x the vertex data) in " << seconds * 1000.0 << " ms" << endl;
+}
+
+void TriangleMesh::buildLods() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    lods.clear();
+    currentLod = 0;
+    // the index buffer holds the levels after the full mesh
+    indexBufferCurrent = false;
+    if (triangles.empty()) return;
+    dequantizeVertices();
+    bool isPacked = !packed.empty();
+    SimplifyVertices input;
+    input.positions = positionData(input.positionStride);
+    input.normals = isPacked ? &packed[0].normal.x : (normals.size() == vertices.size() ? &normals[0].x : nullptr);
+    input.normalStride = isPacked ? sizeof(PackedVertex) : sizeof(Normal);
+    bool textured = isPacked ? packedTextures : textures.size() == vertices.size();
+    input.texCoords = !textured ? nullptr : isPacked ? &packed[0].tex.u : &textures[0].u;
+    input.texCoordStride = isPacked ? sizeof(PackedVertex) : sizeof(Tex2D);
+    input.count = getNumVertices();
+
+    // every level is simplified from the one before, the errors add up
+    const float ratios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+    for (float ratio : ratios) {
+        const Triangles& previous = lods.empty() ? triangles : lods.back().triangles;
+        Lod lod;
+        float error = simplifyMesh(previous, input, (std::size_t)(triangles.size() * ratio), lod.triangles);
+        // the constraints (borders, seams) stop the simplifier
+        if (lod.triangles.empty() || lod.triangles.size() > previous.size() * 9 / 10) break;
+        lod.error = (lods.empty() ? 0.0f : lods.back().error) + error;
+        ::optimizeVertexCache(lod.triangles, input.count);
+        lods.push_back(std::move(lod));
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "buildLods: " << triangles.size();
+    for (const Lod& lod : lods) cout << " -> " << lod.triangles.size() << " (error " << lod.error << ")";
+    cout << " triangles in " << seconds * 1000.0 << " ms" << endl;
+}
+
+const vector<TriangleMesh::Lod>& TriangleMesh::getLods() const {
+    return lods;
+}
+
+void TriangleMesh::buildMeshlets() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    dequantizeVertices();
+    std::size_t stride;
+    const float* positions = positionData(stride);
+    VertexCacheStats before = analyzeVertexCache(triangles, getNumVertices());
+    meshletCones = ::buildMeshlets(triangles, positions, stride, getNumVertices(), meshlets);
+    invalidateTopology();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    VertexCacheStats after = analyzeVertexCache(triangles, getNumVertices());
+    std::size_t withCone = 0;
+    for (const Meshlet& m : meshlets) withCone += m.coneAxis != Vec3f() ? 1 : 0;
+    cout << "buildMeshlets: " << meshlets.size() << " meshlets, "
+         << (meshlets.empty() ? 0.0 : (double)triangles.size() / meshlets.size()) << " triangles each, "
+         << (meshletCones ? "closed, " : "open, ") << withCone << " with a backface cone, ACMR "
+         << before.acmr << " -> " << after.acmr << " in " << seconds * 1000.0 << " ms" << endl;
+}
+
+const vector<Meshlet>& TriangleMesh::getMeshlets() const {
+    return meshlets;
+}
+
+const MeshletCulling& TriangleMesh::getMeshletCulling() const {
+    return meshletCulling;
+}
+
+GLuint TriangleMesh::textureID() const {
+    return texture ? texture->id : 0;
 }
 // ==============
 // === RENDER ===
 // ==============
 
 void TriangleMesh::draw_settings() {
+    // all through the cache: with many meshes nearly every call repeats the last one
+    GLStateCache& state = GLStateCache::instance();
     // enable depth buffer
-    glEnable(GL_DEPTH_TEST);
+    state.setEnabled(GL_DEPTH_TEST, true);
     // set shading model
-    glShadeModel(GL_SMOOTH);
-    // Lightning settings
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, &global_ambient[0]);
-    glLightfv(GL_LIGHT0, GL_AMBIENT, &ambientLight[0]);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, &diffuseLight[0]);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, &specularLight[0]);
-    glLightf(GL_LIGHT0, GL_SHININESS, shininess);
-
-    glEnable(GL_LIGHT0);
+    state.shadeModel(GL_SMOOTH);
+    // Lightning settings (lights have no shininess, that is the material's)
+    state.lightModel(GL_LIGHT_MODEL_AMBIENT, &global_ambient[0]);
+    state.light(GL_LIGHT0, GL_AMBIENT, &ambientLight[0]);
+    state.light(GL_LIGHT0, GL_DIFFUSE, &diffuseLight[0]);
+    state.light(GL_LIGHT0, GL_SPECULAR, &specularLight[0]);
+
+    state.setEnabled(GL_LIGHT0, true);
     // enable use of glColor instead of glMaterial for ambient and diffuse property
-    glEnable(GL_COLOR_MATERIAL);
-    glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+    state.setEnabled(GL_COLOR_MATERIAL, true);
+    state.colorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
     // white shiny specular highlights
-    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, shininessMaterial);
-    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, &specularLightMaterial[0]);
+    state.material(GL_FRONT_AND_BACK, GL_SHININESS, &shininessMaterial);
+    state.material(GL_FRONT_AND_BACK, GL_SPECULAR, &specularLightMaterial[0]);
 }
 
-void TriangleMesh::draw() {
-    draw_settings();
+void TriangleMesh::selectLod(const ViewState& view) {
+    currentLod = 0;
+    if (lods.empty() || lodThreshold <= 0.0f) return;
+    // the coarsest level whose error stays below the threshold on screen
+    for (std::size_t i = lods.size(); i > 0; i--) {
+        if (view.projectedSize(boundsCenter, boundsRadius, lods[i - 1].error) <= lodThreshold) {
+            currentLod = i;
+            return;
+        }
+    }
+}
+
+const TriangleMesh::Triangles& TriangleMesh::drawnTriangles() const {
+    return currentLod == 0 ? triangles : lods[currentLod - 1].triangles;
+}
+
+void TriangleMesh::drawElements(bool buffered) {
+    const Triangles& triangles = drawnTriangles();
+    const char* first = (const char*)triangles.data();
+    if (buffered) {
+        // the levels of detail follow the full mesh in the index buffer
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < currentLod; i++) {
+            offset += (i == 0 ? this->triangles.size() : lods[i - 1].triangles.size()) * sizeof(Triangle);
+        }
+        first = reinterpret_cast<const char*>(offset);
+    }
+    if (currentLod != 0 || meshlets.empty()) {
+        glDrawElements(GL_TRIANGLES, triangles.size() * 3, GL_UNSIGNED_INT, first);
+        return;
+    }
+    visibleMeshlets.clear();
+    if (drawView) meshletCulling = cullMeshlets(meshlets, *drawView, *drawFrustum, visibleMeshlets);
+    else {
+        ViewState view = ViewState::current();
+        meshletCulling = cullMeshlets(meshlets, view, Frustum(view), visibleMeshlets);
+    }
+    // neighbouring visible meshlets are one range
+    drawCounts.clear();
+    drawIndices.clear();
+    uint32_t end = 0;
+    for (uint32_t i : visibleMeshlets) {
+        const Meshlet& m = meshlets[i];
+        if (!drawCounts.empty() && m.firstTriangle == end) drawCounts.back() += 3 * m.numTriangles;
+        else {
+            drawCounts.push_back(3 * m.numTriangles);
+            drawIndices.push_back(first + m.firstTriangle * sizeof(Triangle));
+        }
+        end = m.firstTriangle + m.numTriangles;
+    }
+    if (drawCounts.empty()) return;
+    glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawIndices.data(), (GLsizei)drawCounts.size());
+}
+
+bool TriangleMesh::draw() {
+    ViewState view = ViewState::current();
+    return draw(view, Frustum(view));
+}
+
+bool TriangleMesh::draw(const ViewState& view, const Frustum& frustum) {
+    updateStream();
+    // the glTranslatef below, on the CPU
+    ViewState meshView = view.translated(position);
+    Frustum meshFrustum = frustum.translated(position);
+    // a mesh still streaming in has no bounds yet
+    if (frustumCulling && !stream && !inFrustum(meshFrustum)) return false;
     glPushMatrix();
     glTranslatef(position.x, position.y, position.z);
+    // the shaders take their lighting from the mesh, not from the GL state
+    if (drawMode != 3 || stream) draw_settings();
+    selectLod(meshView);
+    drawView = &meshView;
+    drawFrustum = &meshFrustum;
     switch (drawMode)
     {
     case 0:
         drawImmediate();
+        break;
     case 1:
         drawArray();
+        break;
+    case 2:
+        drawBuffers();
+        break;
     default:
+        drawShaded();
         break;
     }
+    drawView = nullptr;
+    drawFrustum = nullptr;
     glPopMatrix();
+    return true;
+}
+
+bool TriangleMesh::inFrustum(const Frustum& frustum) const {
+    // the sphere rejects most meshes, the box the long thin ones it misses
+    return frustum.sphereVisible(boundsCenter, boundsRadius) && frustum.boxVisible(boundsMin, boundsMax);
 }
 
 void TriangleMesh::drawImmediate() {
+  const Triangles& triangles = drawnTriangles();
   if (triangles.size() == 0) return;
+  GLStateCache& state = GLStateCache::instance();
+  state.useProgram(0);
   // Enable Texture
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, textureID);
+  state.setEnabled(GL_TEXTURE_2D, true);
+  state.bindTexture(textureID());
 
+  bool isPacked = !packed.empty();
+  bool textured = isPacked ? packedTextures : textures.size() == vertices.size();
   glBegin(GL_TRIANGLES);
   for (std::size_t i = 0; i < triangles.size(); i++) {
-      glNormal3f(normals[3*i].x, normals[3*i].y, normals[3*i].z);
-      glTexCoord2f(textures[3*i].u, textures[3*i].v);
-      glVertex3f(vertices[triangles[i].x].x, vertices[triangles[i].x].y, vertices[triangles[i].x].z);
-     
-      glNormal3f(normals[3*i+1].x, normals[3*i+1].y, normals[3*i+1].z);
-  	  glTexCoord2f(textures[3 * i + 1].u, textures[3 * i + 1].v);
-      glVertex3f(vertices[triangles[i].y].x, vertices[triangles[i].y].y, vertices[triangles[i].y].z);
-     
-      glNormal3f(normals[3*i + 2].x, normals[3*i + 2].y, normals[3*i + 2].z);
-  	  glTexCoord2f(textures[3 * i + 2].u, textures[3 * i + 2].v);
-      glVertex3f(vertices[triangles[i].z].x, vertices[triangles[i].z].y, vertices[triangles[i].z].z);
+      for (int k = 0; k < 3; k++) {
+          int v = triangles[i][k];
+          if (!quantized.empty()) {
+              const QuantizedVertex& q = quantized[v];
+              Normal n = decodeOctahedral(q.normal);
+              Vertex p = quantizedBox.decode(q.position);
+              glNormal3f(n.x, n.y, n.z);
+              if (quantizedTextures) glTexCoord2f(halfToFloat(q.tex[0]), halfToFloat(q.tex[1]));
+              glVertex3f(p.x, p.y, p.z);
+              continue;
+          }
+          const Normal& n = isPacked ? packed[v].normal : normals[v];
+          const Vertex& p = isPacked ? packed[v].position : vertices[v];
+          glNormal3f(n.x, n.y, n.z);
+          if (textured) {
+              const Tex2D& t = isPacked ? packed[v].tex : textures[v];
+              glTexCoord2f(t.u, t.v);
+          }
+          glVertex3f(p.x, p.y, p.z);
+      }
   }
   glEnd();
-  glBindTexture(GL_TEXTURE_2D, 0);
-  glDisable(GL_TEXTURE_2D);
 }
 
 void TriangleMesh::drawArray() {
+    GLStateCache& state = GLStateCache::instance();
+    state.bindVertexArray(0);
+    state.bindBuffer(GL_ARRAY_BUFFER, 0);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    drawVertexArrays(false);
+}
+
+void TriangleMesh::drawBuffers() {
+    // the mesh grows every frame, uploading it every frame would cost more
+    if (stream) {
+        drawArray();
+        return;
+    }
+    if (drawnTriangles().empty()) return;
+    uploadBuffers();
+    GLStateCache& state = GLStateCache::instance();
+    state.bindVertexArray(0);
+    state.bindBuffer(GL_ARRAY_BUFFER, buffers->vertexBuffer);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexBuffer);
+    drawVertexArrays(true);
+}
+
+void TriangleMesh::drawVertexArrays(bool buffered) {
+    if (!quantized.empty()) {
+        drawQuantized(buffered);
+        return;
+    }
+    const Triangles& triangles = drawnTriangles();
+    if (triangles.empty()) return;
+    bool isPacked = !packed.empty();
+    bool textured = isPacked ? packedTextures : textures.size() == vertices.size();
+    GLStateCache& state = GLStateCache::instance();
+    state.useProgram(0);
+    // an enabled generic attribute 0 would replace the vertex array
+    for (GLuint i = 0; i < 3; i++) state.setVertexAttribArray(i, false);
     // Enabling Drawing Arrays
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    state.setClientState(GL_VERTEX_ARRAY, true);
+    state.setClientState(GL_NORMAL_ARRAY, true);
+    state.setClientState(GL_TEXTURE_COORD_ARRAY, textured);
+    state.setEnabled(GL_TEXTURE_2D, true);
+    state.bindTexture(textureID());
     // Pointers to the vertices and normals data
     /*glVertexPointer(3, GL_FLOAT, sizeof(Vertex), vertices.data());
     glNormalPointer(GL_FLOAT, sizeof(Normal), normals.data());
     glTexCoordPointer(2, GL_FLOAT, sizeof(Tex2D), textures.data());*/
-    glVertexPointer(3, GL_FLOAT, 0, &vertices[0]);
-    glNormalPointer(GL_FLOAT, 0, &normals[0]);
-    glTexCoordPointer(2, GL_FLOAT, 0, &textures[0]); 
+    vector<const char*> arrays = vertexPointers(buffered);
+    if (isPacked) {
+        // one stream, the attributes are offsets into each record
+        glVertexPointer(3, GL_FLOAT, sizeof(PackedVertex), arrays[0] + offsetof(PackedVertex, position));
+        glNormalPointer(GL_FLOAT, sizeof(PackedVertex), arrays[0] + offsetof(PackedVertex, normal));
+        if (textured) glTexCoordPointer(2, GL_FLOAT, sizeof(PackedVertex), arrays[0] + offsetof(PackedVertex, tex));
+    }
+    else {
+        glVertexPointer(3, GL_FLOAT, 0, arrays[0]);
+        glNormalPointer(GL_FLOAT, 0, arrays[1]);
+        if (textured) glTexCoordPointer(2, GL_FLOAT, 0, arrays[2]);
+    }
     // drawing the elements
-    glDrawElements(GL_TRIANGLES, triangles.size()*3, GL_UNSIGNED_INT, &triangles[0]);
-
-    // We disable normal and vertex arrays again
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisable(GL_TEXTURE_2D);
-}
\ No newline at end of file
+    drawElements(buffered);
+}
+
+// the fixed function lighting of draw_settings (GL_LIGHT0, ambient and diffuse
+// from glColor, infinite viewer) per vertex, on decoded quantized attributes
+static const char* quantizedVertexShader = R"(
+#version 120
+attribute vec3 position;
+attribute vec2 octNormal;
+attribute vec2 texCoord;
+uniform vec3 boundsMin;
+uniform vec3 boundsExtent;
+
+vec3 decodeOctahedral(vec2 o) {
+    vec3 n = vec3(o, 1.0 - abs(o.x) - abs(o.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(o.yx)) * vec2(o.x >= 0.0 ? 1.0 : -1.0, o.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main() {
+    vec4 p = vec4(boundsMin + boundsExtent * position, 1.0);
+    vec3 eye = vec3(gl_ModelViewMatrix * p);
+    vec3 n = normalize(gl_NormalMatrix * decodeOctahedral(octNormal));
+    vec4 light = gl_LightSource[0].position;
+    vec3 l = normalize(light.w == 0.0 ? light.xyz : light.xyz - eye);
+    float diffuse = max(dot(n, l), 0.0);
+    float specular = 0.0;
+    if (diffuse > 0.0) specular = pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess);
+    vec3 color = gl_Color.rgb * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb + gl_LightSource[0].diffuse.rgb * diffuse)
+               + gl_FrontMaterial.specular.rgb * gl_LightSource[0].specular.rgb * specular;
+    gl_FrontColor = vec4(color, gl_Color.a);
+    gl_TexCoord[0] = vec4(texCoord, 0.0, 1.0);
+    gl_Position = gl_ModelViewProjectionMatrix * p;
+}
+)";
+
+static const char* quantizedFragmentShader = R"(
+#version 120
+uniform sampler2D colorTexture;
+// false without a texture, the fixed function pipeline does not texture then
+uniform bool textured;
+
+void main() {
+    gl_FragColor = textured ? gl_Color * texture2D(colorTexture, gl_TexCoord[0].st) : gl_Color;
+}
+)";
+
+struct QuantizedProgram {
+    GLuint program;
+    GLint boundsMin, boundsExtent, colorTexture, textured;
+};
+
+// shared by all meshes, built on first use. program stays 0 if that fails
+static const QuantizedProgram& quantizedProgram() {
+    static QuantizedProgram shader = { 0, -1, -1, -1, -1 };
+    static bool built = false;
+    if (built) return shader;
+    built = true;
+    shader.program = buildProgram("quantized", quantizedVertexShader, quantizedFragmentShader,
+                                  { "position", "octNormal", "texCoord" });
+    if (!shader.program) return shader;
+    shader.boundsMin = glGetUniformLocation(shader.program, "boundsMin");
+    shader.boundsExtent = glGetUniformLocation(shader.program, "boundsExtent");
+    shader.colorTexture = glGetUniformLocation(shader.program, "colorTexture");
+    shader.textured = glGetUniformLocation(shader.program, "textured");
+    return shader;
+}
+
+void TriangleMesh::drawQuantized(bool buffered) {
+    const Triangles& triangles = drawnTriangles();
+    if (triangles.empty()) return;
+    const QuantizedProgram& shader = quantizedProgram();
+    if (!shader.program) return;
+    GLStateCache& state = GLStateCache::instance();
+    state.useProgram(shader.program);
+    glUniform3f(shader.boundsMin, quantizedBox.min.x, quantizedBox.min.y, quantizedBox.min.z);
+    glUniform3f(shader.boundsExtent, quantizedBox.extent.x, quantizedBox.extent.y, quantizedBox.extent.z);
+    glUniform1i(shader.colorTexture, 0);
+    glUniform1i(shader.textured, textureID() != 0);
+    state.bindTexture(textureID());
+    state.setClientState(GL_VERTEX_ARRAY, false);
+    state.setClientState(GL_NORMAL_ARRAY, false);
+    state.setClientState(GL_TEXTURE_COORD_ARRAY, false);
+    setVertexAttributes(buffered);
+    drawElements(buffered);
+}
+
+void TriangleMesh::setVertexAttributes(bool buffered) {
+    vector<const char*> arrays = vertexPointers(buffered);
+    bool textured;
+    if (!quantized.empty()) {
+        // the records as they are: unorm16 positions and snorm8 normals come
+        // in as [0, 1] and [-1, 1], the texture coordinates as half floats
+        textured = quantizedTextures;
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex),
+                              arrays[0] + offsetof(QuantizedVertex, position));
+        glVertexAttribPointer(1, 2, GL_BYTE, GL_TRUE, sizeof(QuantizedVertex),
+                              arrays[0] + offsetof(QuantizedVertex, normal));
+        if (textured) glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex),
+                                            arrays[0] + offsetof(QuantizedVertex, tex));
+    }
+    else if (!packed.empty()) {
+        textured = packedTextures;
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), arrays[0] + offsetof(PackedVertex, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), arrays[0] + offsetof(PackedVertex, normal));
+        if (textured) glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), arrays[0] + offsetof(PackedVertex, tex));
+    }
+    else {
+        textured = arrays.size() > 2;
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, arrays[0]);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, arrays[1]);
+        if (textured) glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, arrays[2]);
+    }
+    GLStateCache& state = GLStateCache::instance();
+    state.setVertexAttribArray(0, true);
+    state.setVertexAttribArray(1, true);
+    state.setVertexAttribArray(2, textured);
+    if (!textured) glVertexAttrib2f(2, 0.0f, 0.0f);
+}
+
+void TriangleMesh::drawShaded() {
+    // as drawBuffers, with the legacy pipeline
+    if (stream) {
+        drawArray();
+        return;
+    }
+    if (drawnTriangles().empty()) return;
+    bool isQuantized = !quantized.empty();
+    const ShaderProgram& shader = shaderProgram(isQuantized);
+    if (!shader.program) return;
+    uploadBuffers();
+    GLStateCache& state = GLStateCache::instance();
+    if (!buffers->vertexArray) {
+        glGenVertexArrays(1, &buffers->vertexArray);
+        vertexArrayCurrent = false;
+    }
+    state.bindVertexArray(buffers->vertexArray);
+    if (!vertexArrayCurrent) {
+        state.bindBuffer(GL_ARRAY_BUFFER, buffers->vertexBuffer);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexBuffer);
+        setVertexAttributes(true);
+        vertexArrayCurrent = true;
+    }
+    else if (!(isQuantized ? quantizedTextures : packed.empty() ? textures.size() == vertices.size() : packedTextures)) {
+        // the constant attribute is not part of the vertex array object
+        glVertexAttrib2f(2, 0.0f, 0.0f);
+    }
+
+    // the camera and the light position as the app set them up for the
+    // fixed function pipeline, the colors of draw_settings. the same for all
+    // meshes of a frame, so the block is uploaded once
+    FrameUniforms frame;
+    ViewState view = drawView ? *drawView : ViewState::current();
+    memcpy(frame.projection, view.projection, sizeof(frame.projection));
+    frameLighting(frame.lightPosition, frame.materialColor);
+    for (int i = 0; i < 4; i++) {
+        frame.lightAmbient[i] = ambientLight[i];
+        frame.lightDiffuse[i] = diffuseLight[i];
+        frame.lightSpecular[i] = specularLight[i];
+        frame.sceneAmbient[i] = global_ambient[i];
+        frame.materialSpecular[i] = specularLightMaterial[i];
+    }
+    frame.shininess = shininessMaterial;
+    frame.padding[0] = frame.padding[1] = frame.padding[2] = 0.0f;
+    setFrameUniforms(frame);
+
+    state.setEnabled(GL_DEPTH_TEST, true);
+    state.useProgram(shader.program);
+    setModelview(shader, view.modelview);
+    glUniform1i(shader.colorTexture, 0);
+    glUniform1i(shader.textured, textureID() != 0);
+    if (isQuantized) {
+        glUniform3f(shader.boundsMin, quantizedBox.min.x, quantizedBox.min.y, quantizedBox.min.z);
+        glUniform3f(shader.boundsExtent, quantizedBox.extent.x, quantizedBox.extent.y, quantizedBox.extent.z);
+    }
+    state.bindTexture(textureID());
+    drawElements(true);
+}
@@ -13,16 +13,25 @@
 #define TRIANGLEMESH_H
 
 #include <vector>
+#include <memory>
 #include "Vec3.h"
+#include "MeshTopology.h"
+#include "Quantize.h"
+#include "Meshlets.h"
+#include <GL/glew.h>
 #include <GL/glut.h>
 
 #define M_PI 3.14159265358979f
 
 using namespace std;
 
+struct MeshStream;
+struct Texture;
+struct MeshBuffers;
+
 class TriangleMesh  {
 
-private:
+public:
 
   // typedefs for data
   typedef Vec3i Triangle;
@@ -35,6 +44,31 @@ private:
   struct Tex2D { float u, v; };
   typedef vector<Tex2D> Textures;
   typedef vector<Vec3i> TriTextures;
+  // one vertex of the interleaved layout. 32 bytes, so two records share a
+  // cache line and none straddles one
+  struct alignas(32) PackedVertex {
+    Vertex position;
+    Normal normal;
+    Tex2D tex;
+  };
+  typedef vector<PackedVertex> PackedVertices;
+  // one vertex of the quantized layout (see Quantize.h), 12 bytes: position
+  // in the bounding box as unsigned shorts, octahedral normal in two signed
+  // bytes, texture coordinates as half floats
+  struct QuantizedVertex {
+    uint16_t position[3];
+    int8_t normal[2];
+    uint16_t tex[2];
+  };
+  typedef vector<QuantizedVertex> QuantizedVertices;
+  // a simplified version of the mesh on the same vertices. error is the
+  // geometric error against the full mesh in object space
+  struct Lod {
+    Triangles triangles;
+    float error;
+  };
+
+private:
 
   // data of TriangleMesh
   Vertices vertices;
@@ -44,8 +78,76 @@ private:
   Textures textures;
   // Texture indices used for each triangle
   TriTextures triTextures;
-  unsigned int textureID;
+  // interleaved layout: vertices, normals and textures are empty and all
+  // vertex data is here instead
+  PackedVertices packed;
+  // packed has real texture coordinates (not zeros for a mesh without)
+  bool packedTextures;
+  // load into (and convert to) the interleaved layout
+  bool interleaved;
+  // quantized layout: all vertex data is here, the other arrays are empty.
+  // positions are relative to quantizedBox
+  QuantizedVertices quantized;
+  bool quantizedTextures;
+  PositionQuantization quantizedBox;
+  QuantizationError quantizationError;
+  // convert to the quantized layout after loading
+  bool quantize;
+  shared_ptr<Texture> texture;
+  // 0 immediate mode, 1 client vertex arrays, 2 buffer objects (default),
+  // 3 shaders (drawShaded)
   unsigned int drawMode;
+  // vertex arrays and triangles of all levels of detail in GL_STATIC_DRAW
+  // buffer objects for drawMode 2, shared by copies of the mesh. the first
+  // draw after the vertices or triangles changed uploads them again
+  shared_ptr<MeshBuffers> buffers;
+  bool vertexBufferCurrent, indexBufferCurrent;
+  // the vertex array object of drawShaded points into the current vertex buffer
+  bool vertexArrayCurrent;
+  // merge OBJ corners with identical (v, vt, vn) into one vertex
+  bool weldVertices;
+  // read and write binary caches next to the loaded files
+  bool useMeshCache;
+  // reorder the loaded triangles for the GPU (see optimizeVertexCache)
+  bool optimizeOnLoad;
+  // levels of detail, coarser ones later (see buildLods)
+  vector<Lod> lods;
+  bool buildLodsOnLoad;
+  // largest error on screen in pixels draw accepts from a level of detail
+  float lodThreshold;
+  // level drawn, 0 is the full mesh and i is lods[i - 1]
+  std::size_t currentLod;
+  // clusters of triangles culled on their own (see Meshlets.h), empty if
+  // the triangles changed order since buildMeshlets
+  vector<Meshlet> meshlets;
+  bool buildMeshletsOnLoad;
+  // the mesh is closed, the meshlets have backface cones
+  bool meshletCones;
+  // of the last drawArray, and its scratch arrays
+  MeshletCulling meshletCulling;
+  vector<uint32_t> visibleMeshlets;
+  vector<GLsizei> drawCounts;
+  vector<const GLvoid*> drawIndices;
+  // axis aligned bounding box of vertices and a sphere around them, tighter
+  // than the one around the box
+  Vec3f boundsMin, boundsMax;
+  Vec3f boundsCenter;
+  float boundsRadius;
+  // draw skips the mesh if the sphere or the box is outside the view frustum
+  bool frustumCulling;
+  // view and frustum of the mesh while draw runs, null outside of it: the
+  // draw paths called on their own read the view from GL
+  const ViewState* drawView;
+  const Frustum* drawFrustum;
+  // adjacency (see getTopology) and face normals for updateNormals, built
+  // on first use. empty while out of date
+  MeshTopology topology;
+  vector<Vec3f> faceNormals;
+  // vertices moved since the last updateNormals, each listed once (dirtyMark)
+  vector<uint32_t> dirtyVertices;
+  vector<unsigned char> dirtyMark;
+  // background load in progress (loadStreaming), shared by copies of the mesh
+  shared_ptr<MeshStream> stream;
   // Local Position translation of triangle mesh
   Vec3f position;
 
@@ -58,7 +160,57 @@ private:
   GLfloat shininess;
 
   // private methods
-  void calculateNormals();
+  GLuint textureID() const;
+  // numThreads as for the loaders, the result does not depend on it
+  void calculateNormals(unsigned int numThreads = 1);
+  // also the bounding sphere
+  void calculateBounds();
+  void calculateBoundingSphere();
+  // common end of all loaders: optimizers, meshlets, levels of detail,
+  // layout, bounds and mesh cache. prints its time apart from the parse
+  void finishLoad(const char* filename);
+  // takes over the data of a mesh that finishLoad ran on, marks the buffers
+  // out of date and converts to the layout set now
+  void takeLoaded(TriangleMesh& loaded);
+  // moves the vertex data between the separate arrays and packed
+  void packVertices();
+  void unpackVertices();
+  // moves the vertex data from the current layout into quantized and back
+  // (into the layout interleaved asks for). the way back keeps the errors
+  void quantizeVertices();
+  void dequantizeVertices();
+  // load options that change the loaded data. part of the cache key
+  unsigned int cacheFlags() const;
+  // bytes per vertex of each vertex array in the current layout
+  vector<std::size_t> vertexStrides() const;
+  // first position and the distance between two positions in bytes
+  const float* positionData(std::size_t& stride) const;
+  // first byte of each vertex array, in the order of vertexStrides. buffered
+  // gives the offsets of the arrays in the vertex buffer instead, which holds
+  // them one after the other
+  vector<const char*> vertexPointers(bool buffered) const;
+  // uploads what is out of date to buffers
+  void uploadBuffers();
+  // drops topology and faceNormals and marks the index buffer out of date,
+  // after the triangles changed
+  void invalidateTopology();
+  // chooses currentLod from the screen size of the bounding sphere
+  void selectLod(const ViewState& view);
+  // triangles of currentLod
+  const Triangles& drawnTriangles() const;
+  // glDrawElements of drawnTriangles, of the full mesh only the meshlets
+  // that pass the culling. buffered takes them from the bound index buffer
+  void drawElements(bool buffered);
+  // new spheres and cones for the meshlets around the moved vertices
+  void refitMeshlets(const vector<uint32_t>& moved);
+  // drawArray and drawBuffers, buffered draws from the buffer objects
+  void drawVertexArrays(bool buffered);
+  // points the generic attributes 0 (position), 1 (normal) and 2 (texture
+  // coordinates) at the vertex arrays of the current layout
+  void setVertexAttributes(bool buffered);
+  // drawVertexArrays of the quantized layout, with a shader that decodes the
+  // attributes (GL 2.0 and half float vertex attributes)
+  void drawQuantized(bool buffered);
 
 public:
 
@@ -76,41 +228,171 @@ public:
   // === RAW DATA ===
   // ================
 
-  // get raw data references
+  // get raw data references. points and normals are empty in the
+  // interleaved layout, use getPackedVertices then
   vector<Vec3f>& getPoints();
   vector<Vec3i>& getTriangles();
   vector<Vec3f>& getNormals();
+  PackedVertices& getPackedVertices();
+  QuantizedVertices& getQuantizedVertices();
+  std::size_t getNumVertices() const;
+  // memory of the vertex arrays in the current layout
+  std::size_t getVertexBytes() const;
+  // adjacency of the triangles (see MeshTopology.h), built on the first call
+  // after the triangles changed
+  const MeshTopology& getTopology();
 
   // flip all normals
   void flipNormals();
 
+  // ===================
+  // === MODIFY MESH ===
+  // ===================
+
+  // moves vertex v. its normal and the ones of its neighbours follow with
+  // the next updateNormals
+  void setVertexPosition(std::size_t v, const Vertex& p);
+  // marks vertices [first, last) as moved, after changing them through
+  // getPoints or getPackedVertices
+  void markDirty(std::size_t first, std::size_t last);
+  // recomputes the normals around the moved vertices. the cost is in the
+  // size of the edit, except for the first call, which builds the adjacency.
+  // the new normals are the ones calculateNormals gives without file normals.
+  // the bounds grow to include the moved vertices and the meshlets around
+  // them get new spheres and cones. returns the number of normals recomputed
+  std::size_t updateNormals();
+
   void setPosition(float x, float y, float z);
+  const Vec3f& getPosition() const;
+  // cycles through immediate mode, vertex arrays, buffer objects and shaders
   void switchDrawMode();
+  // one of them, as numbered for drawMode
+  void setDrawMode(unsigned int mode);
+  // share vertices between OBJ faces (default) instead of one vertex per corner
+  void setWeldVertices(bool weld);
+  // reuse binary caches of loaded files (default)
+  void setUseMeshCache(bool use);
+  // run the optimization passes after every load (default)
+  void setOptimizeOnLoad(bool optimize);
+  // build levels of detail after every load (default off, the simplifier
+  // takes seconds on meshes with millions of triangles)
+  void setBuildLods(bool build);
+  // build meshlets after every load (default)
+  void setBuildMeshlets(bool build);
+  // error in pixels up to which draw uses a coarser level of detail
+  // (default 1). 0 always draws the full mesh
+  void setLodThreshold(float pixels);
+  // store vertices as interleaved PackedVertex records instead of separate
+  // arrays (default off). converts loaded data, a running loadStreaming
+  // converts when it is done
+  void setInterleaved(bool interleave);
+  bool isInterleaved() const;
+  // store vertices as QuantizedVertex records (default off), 12 instead of 24
+  // to 32 bytes per vertex. converts loaded data, loads convert after the
+  // optimization passes and the mesh cache, which keep full precision.
+  // editing, optimizing or simplifying a quantized mesh decodes it first, call
+  // setQuantized(true) again afterwards
+  void setQuantized(bool quantizeVertices);
+  bool isQuantized() const;
+  // largest errors of the last conversion to the quantized layout
+  const QuantizationError& getQuantizationError() const;
+
+  // bounding box and sphere, valid after loading
+  const Vec3f& getBoundsMin() const;
+  const Vec3f& getBoundsMax() const;
+  const Vec3f& getBoundsCenter() const;
+  float getBoundsRadius() const;
+  // skip meshes outside the view frustum in draw (default). a mesh still
+  // streaming in is always drawn
+  void setFrustumCulling(bool cull);
 
   // =================
   // === LOAD MESH ===
   // =================
 
-  // read from an LSA file. also calculates normals.
-  void loadLSA(const char* filename);
+  // read from an LSA file. also calculates normals. numThreads works like
+  // for loadOBJ
+  void loadLSA(const char* filename, unsigned int numThreads = 1);
+
+  // read from an OFF file. also calculates normals. polygons are fan
+  // triangulated. numThreads works like for loadOBJ
+  void loadOFF(const char* filename, unsigned int numThreads = 1);
 
-  // read from an OFF file. also calculates normals.
-  void loadOFF(const char* filename);
+  // read OBJ file. the file is split into chunks that are parsed by
+  // numThreads threads (0 = one per core). the result does not depend on numThreads
+  void loadOBJ(const char* filename, unsigned int numThreads = 1);
 
-  // read OBJ file
-  void loadOBJ(const char* filename);
+  // read an OBJ, OFF or LSA file on a background thread. the mesh grows
+  // while the file is read, see updateStream
+  void loadStreaming(const char* filename);
+  // takes over what the background load finished so far (called by draw).
+  // returns true while the load is still running
+  bool updateStream();
+  // the end of loadStreaming on the background thread: takes the whole file,
+  // calculates the normals and runs the passes of the other loaders. no GL calls
+  void finishStreamedLoad(Vertices& allVertices, Normals& fileNormals, Textures& allTextures,
+                          Triangles& allTriangles, const char* filename);
+  bool isLoading() const;
 
+  // binary cache of a mesh file (see MeshCache.h). loadCache returns false if
+  // there is no cache or it does not match the file and the load options
+  bool loadCache(const char* filename);
+  bool saveCache(const char* filename);
+
+  // loads the texture asynchronously (see TextureLoader)
   void loadTexture(const char* filename);
 
+  // ====================
+  // === OPTIMIZATION ===
+  // ====================
+
+  // reorders triangles for the post-transform vertex cache (see
+  // MeshOptimizer.h) and prints ACMR and ATVR before and after
+  void optimizeVertexCache();
+  // reorders clusters of the (vertex cache optimized) triangles so that
+  // outer, outward facing ones are drawn first. threshold bounds the ACMR
+  // loss (see MeshOptimizer.h)
+  void optimizeOverdraw(float threshold = 1.05f);
+  // renumbers the vertices in order of their first use by triangles, so
+  // drawing reads the vertex arrays front to back. prints the cache lines
+  // loaded per draw before and after
+  void optimizeVertexFetch();
+  // simplifies the mesh to levels of detail with 50, 25, 12.5 and 6.25
+  // percent of the triangles (see MeshSimplifier.h). stops early at a level
+  // that does not get smaller
+  void buildLods();
+  const vector<Lod>& getLods() const;
+  // groups the triangles into meshlets and reorders them (see Meshlets.h).
+  // drawArray then draws only the meshlets inside the view frustum that are
+  // not facing away. the other optimization passes reorder the triangles,
+  // run them before. prints the meshlet sizes
+  void buildMeshlets();
+  const vector<Meshlet>& getMeshlets() const;
+  // counts of the last drawArray of the full mesh
+  const MeshletCulling& getMeshletCulling() const;
+
   // ==============
   // === RENDER ===
   // ==============
   
   // draw mesh with set transformation
   void draw_settings();
-  void draw();
+  // false if the mesh was culled. reads the view from GL
+  bool draw();
+  // draw with the view and its frustum before the glTranslatef to the mesh
+  // position, so objects can hand the one they computed to all their meshes
+  bool draw(const ViewState& view, const Frustum& frustum);
+  // whether the bounds may be inside frustum, in the coordinates of the vertices
+  bool inFrustum(const Frustum& frustum) const;
   void drawImmediate();
   void drawArray();
+  // drawArray from buffer objects: the data crosses the bus once, not every
+  // frame. a mesh still streaming in is drawn with drawArray
+  void drawBuffers();
+  // drawBuffers with the programmable pipeline (see ShaderRenderer.h): per
+  // pixel lighting with the colors of draw_settings, the camera, light
+  // position and glColor of the current GL state. needs GL 3.3
+  void drawShaded();
 
 
 };
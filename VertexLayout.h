@@ -0,0 +1,249 @@
+#pragma once
+
+// The two vertex layouts of TriangleMesh and the per vertex passes written
+// against both of them. SeparateLayout points into one array per attribute,
+// PackedLayout into one array of 32 byte records (TriangleMesh::PackedVertex),
+// so a vertex fetch touches one cache line instead of three.
+
+#include <algorithm>
+#include <cstddef>
+#include "TriangleMesh.h"
+#include "MeshTopology.h"
+#include "Parallel.h"
+#include "SimdMath.h"
+#include "Quantize.h"
+
+using namespace std;
+
+static_assert(sizeof(TriangleMesh::PackedVertex) == 32, "PackedVertex has to fill half a cache line");
+static_assert(sizeof(TriangleMesh::QuantizedVertex) == 12, "QuantizedVertex has to stay 4 byte aligned without padding");
+
+struct SeparateLayout {
+    SeparateLayout(TriangleMesh::Vertex* positions, TriangleMesh::Normal* normals, TriangleMesh::Tex2D* textures)
+        : positions(positions), normals(normals), textures(textures) {
+    }
+    TriangleMesh::Vertex& position(std::size_t i) const { return positions[i]; }
+    TriangleMesh::Normal& normal(std::size_t i) const { return normals[i]; }
+    // textures may be null (mesh without texture coordinates)
+    TriangleMesh::Tex2D& tex(std::size_t i) const { return textures[i]; }
+
+    TriangleMesh::Vertex* positions;
+    TriangleMesh::Normal* normals;
+    TriangleMesh::Tex2D* textures;
+};
+
+struct PackedLayout {
+    explicit PackedLayout(TriangleMesh::PackedVertex* vertices)
+        : vertices(vertices) {
+    }
+    TriangleMesh::Vertex& position(std::size_t i) const { return vertices[i].position; }
+    TriangleMesh::Normal& normal(std::size_t i) const { return vertices[i].normal; }
+    TriangleMesh::Tex2D& tex(std::size_t i) const { return vertices[i].tex; }
+
+    TriangleMesh::PackedVertex* vertices;
+};
+
+// not normalized, the length is twice the area
+template<class Layout>
+inline Vec3f faceNormal(const Layout& layout, const Vec3i& t) {
+    Vec3f const& p1 = layout.position(t[0]);
+    Vec3f const& p2 = layout.position(t[1]);
+    Vec3f const& p3 = layout.position(t[2]);
+    const Vec3f edge1 = p1 - p2;
+    const Vec3f edge2 = p1 - p3;
+    return edge1 ^ edge2;
+}
+
+// normalizes the normals of vertices [first, last) with the same result as
+// Vec3f::normalize (shorter than 0.00001 stay as they are), four at a time with SSE
+template<class Layout>
+void normalizeNormals(const Layout& layout, std::size_t first, std::size_t last) {
+    std::size_t i = first;
+#ifdef HAVE_SSE2
+    // l <= 0.00001f in float is l < 0.00001 in double, as normalize compares
+    const __m128 minLength = _mm_set1_ps(0.00001f);
+    for (; i + 4 <= last; i += 4) {
+        Vec3f& n0 = layout.normal(i);
+        Vec3f& n1 = layout.normal(i + 1);
+        Vec3f& n2 = layout.normal(i + 2);
+        Vec3f& n3 = layout.normal(i + 3);
+        __m128 x = _mm_setr_ps(n0.x, n1.x, n2.x, n3.x);
+        __m128 y = _mm_setr_ps(n0.y, n1.y, n2.y, n3.y);
+        __m128 z = _mm_setr_ps(n0.z, n1.z, n2.z, n3.z);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 keep = _mm_cmple_ps(length, minLength);
+        x = _mm_or_ps(_mm_and_ps(keep, x), _mm_andnot_ps(keep, _mm_div_ps(x, length)));
+        y = _mm_or_ps(_mm_and_ps(keep, y), _mm_andnot_ps(keep, _mm_div_ps(y, length)));
+        z = _mm_or_ps(_mm_and_ps(keep, z), _mm_andnot_ps(keep, _mm_div_ps(z, length)));
+        float xs[4], ys[4], zs[4];
+        _mm_storeu_ps(xs, x);
+        _mm_storeu_ps(ys, y);
+        _mm_storeu_ps(zs, z);
+        n0.set(xs[0], ys[0], zs[0]);
+        n1.set(xs[1], ys[1], zs[1]);
+        n2.set(xs[2], ys[2], zs[2]);
+        n3.set(xs[3], ys[3], zs[3]);
+    }
+#endif
+    for (; i < last; i++) {
+        layout.normal(i).normalize();
+    }
+}
+
+// adds the face normals to the normals of their corners, then normalizes
+// all numVertices normals
+template<class Layout>
+void accumulateNormals(const Layout& layout, const Vec3i* triangles, std::size_t numTriangles,
+                       std::size_t numVertices) {
+    for (std::size_t i = 0; i < numTriangles; i++) {
+        const Vec3i& t = triangles[i];
+        const Vec3f normal = faceNormal(layout, t);
+        layout.normal(t[0]) += normal;
+        layout.normal(t[1]) += normal;
+        layout.normal(t[2]) += normal;
+    }
+    normalizeNormals(layout, 0, numVertices);
+}
+
+// accumulateNormals on numThreads threads (0 = one per core) with the same
+// result bit for bit. the face normals are computed in parallel, then every
+// vertex gathers the ones of its triangles (topology of triangles) in
+// ascending order, so the sums are added in the serial order and no two
+// threads write the same normal
+template<class Layout>
+void accumulateNormals(const Layout& layout, const Vec3i* triangles, const MeshTopology& topology,
+                       unsigned int numThreads) {
+    const std::size_t numTriangles = topology.getNumTriangles();
+    const std::size_t numVertices = topology.getNumVertices();
+    vector<Vec3f> faceNormals(numTriangles);
+    unsigned int numBlocks = topologyThreadCount(numTriangles, numThreads);
+    parallelFor(numBlocks, [&](unsigned int b) {
+        std::size_t last = numTriangles * (b + 1) / numBlocks;
+        for (std::size_t i = numTriangles * b / numBlocks; i < last; i++) faceNormals[i] = faceNormal(layout, triangles[i]);
+    });
+    numBlocks = topologyThreadCount(numVertices, numThreads);
+    parallelFor(numBlocks, [&](unsigned int b) {
+        std::size_t first = numVertices * b / numBlocks;
+        std::size_t last = numVertices * (b + 1) / numBlocks;
+        for (std::size_t v = first; v < last; v++) {
+            Vec3f& normal = layout.normal(v);
+            for (uint32_t t : topology.vertexTriangles(v)) normal += faceNormals[t];
+        }
+        normalizeNormals(layout, first, last);
+    });
+}
+
+// recomputes the normals around the moved vertices dirty: the face normals
+// of their triangles (faceNormals, one per triangle, the others have to be
+// up to date) and the normals of all corners of those triangles, which are
+// appended to updated. mark has one zero entry per vertex and is zero again
+// afterwards. the normals come out as from accumulateNormals on zero normals
+template<class Layout>
+void updateNormals(const Layout& layout, const Vec3i* triangles, const MeshTopology& topology,
+                   vector<Vec3f>& faceNormals, const vector<uint32_t>& dirty, vector<unsigned char>& mark,
+                   vector<uint32_t>& updated) {
+    const unsigned char isDirty = 1, isUpdated = 2;
+    for (uint32_t v : dirty) mark[v] |= isDirty;
+    for (uint32_t v : dirty) {
+        for (uint32_t t : topology.vertexTriangles(v)) {
+            const Vec3i& triangle = triangles[t];
+            // once per triangle: by its first dirty corner
+            int first = (mark[triangle[0]] & isDirty) ? 0 : (mark[triangle[1]] & isDirty) ? 1 : 2;
+            if ((uint32_t)triangle[first] == v) faceNormals[t] = faceNormal(layout, triangle);
+            for (int k = 0; k < 3; k++) {
+                if (mark[triangle[k]] & isUpdated) continue;
+                mark[triangle[k]] |= isUpdated;
+                updated.push_back((uint32_t)triangle[k]);
+            }
+        }
+    }
+    for (uint32_t v : updated) {
+        // the sum in triangle order, as accumulateNormals adds them
+        Vec3f normal;
+        for (uint32_t t : topology.vertexTriangles(v)) normal += faceNormals[t];
+        normal.normalize();
+        layout.normal(v) = normal;
+        mark[v] = 0;
+    }
+    for (uint32_t v : dirty) mark[v] = 0;
+}
+
+// face normals of all triangles, not normalized
+template<class Layout>
+void computeFaceNormals(const Layout& layout, const Vec3i* triangles, std::size_t numTriangles,
+                        vector<Vec3f>& faceNormals) {
+    faceNormals.resize(numTriangles);
+    for (std::size_t i = 0; i < numTriangles; i++) faceNormals[i] = faceNormal(layout, triangles[i]);
+}
+
+// bounds of numVertices positions, both zero if there are none
+template<class Layout>
+void computeBounds(const Layout& layout, std::size_t numVertices, Vec3f& boundsMin, Vec3f& boundsMax) {
+    boundsMin.clear();
+    boundsMax.clear();
+    if (numVertices == 0) return;
+    boundsMin = layout.position(0);
+    boundsMax = layout.position(0);
+    for (std::size_t v = 0; v < numVertices; v++) {
+        const Vec3f& p = layout.position(v);
+        for (int i = 0; i < 3; i++) {
+            boundsMin[i] = std::min(boundsMin[i], p[i]);
+            boundsMax[i] = std::max(boundsMax[i], p[i]);
+        }
+    }
+}
+
+// sphere around the center of the bounds through the farthest of numVertices
+// positions. radius zero if there are none
+template<class Layout>
+void computeBoundingSphere(const Layout& layout, std::size_t numVertices, const Vec3f& boundsMin,
+                           const Vec3f& boundsMax, Vec3f& center, float& radius) {
+    center = (boundsMin + boundsMax) * 0.5f;
+    float squared = 0.0f;
+    for (std::size_t v = 0; v < numVertices; v++) squared = std::max(squared, (layout.position(v) - center).sqlength());
+    radius = sqrtf(squared);
+}
+
+// encodes numVertices vertices into out, positions relative to box. without
+// textured the texture coordinates are zero. returns the largest errors of
+// the decoded data
+template<class Layout>
+QuantizationError quantizeVertices(const Layout& layout, std::size_t numVertices, bool textured,
+                                   const PositionQuantization& box, TriangleMesh::QuantizedVertex* out) {
+    QuantizationError error;
+    float minCosine = 1.0f;
+    for (std::size_t v = 0; v < numVertices; v++) {
+        TriangleMesh::QuantizedVertex& q = out[v];
+        const Vec3f& p = layout.position(v);
+        box.encode(p, q.position);
+        error.position = std::max(error.position, (box.decode(q.position) - p).length());
+        const Vec3f& n = layout.normal(v);
+        encodeOctahedral(n, q.normal);
+        float length = n.length();
+        if (length > 0.00001f) minCosine = std::min(minCosine, decodeOctahedral(q.normal) * n / length);
+        q.tex[0] = q.tex[1] = 0;
+        if (!textured) continue;
+        const TriangleMesh::Tex2D& t = layout.tex(v);
+        q.tex[0] = floatToHalf(t.u);
+        q.tex[1] = floatToHalf(t.v);
+        error.texCoord = std::max(error.texCoord, std::max(fabsf(halfToFloat(q.tex[0]) - t.u),
+                                                           fabsf(halfToFloat(q.tex[1]) - t.v)));
+    }
+    error.normalDegrees = acosf(std::min(std::max(minCosine, -1.0f), 1.0f)) * 180.0f / M_PI;
+    return error;
+}
+
+// decodes numVertices vertices of in into layout. texture coordinates only
+// if textured
+template<class Layout>
+void dequantizeVertices(const TriangleMesh::QuantizedVertex* in, std::size_t numVertices, bool textured,
+                        const PositionQuantization& box, const Layout& layout) {
+    for (std::size_t v = 0; v < numVertices; v++) {
+        const TriangleMesh::QuantizedVertex& q = in[v];
+        layout.position(v) = box.decode(q.position);
+        layout.normal(v) = decodeOctahedral(q.normal);
+        if (!textured) continue;
+        layout.tex(v).u = halfToFloat(q.tex[0]);
+        layout.tex(v).v = halfToFloat(q.tex[1]);
+    }
+}
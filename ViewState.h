@@ -0,0 +1,117 @@
+#pragma once
+
+// The fixed function transformation of the current draw call, read back from
+// GL, and what it does to sizes and the view volume in object space.
+
+#include <GL/glew.h>
+#include <GL/glut.h>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include "Vec3.h"
+
+using namespace std;
+
+struct ViewState {
+    // column major, as GL returns them
+    GLfloat modelview[16];
+    GLfloat projection[16];
+    GLint viewport[4];
+
+    static ViewState current() {
+        ViewState view;
+        glGetFloatv(GL_MODELVIEW_MATRIX, view.modelview);
+        glGetFloatv(GL_PROJECTION_MATRIX, view.projection);
+        glGetIntegerv(GL_VIEWPORT, view.viewport);
+        return view;
+    }
+
+    // the view after glTranslatef(offset), computed as GL does
+    ViewState translated(const Vec3f& offset) const {
+        ViewState view = *this;
+        const GLfloat* m = modelview;
+        for (int r = 0; r < 4; r++) {
+            view.modelview[12 + r] = m[r] * offset.x + m[4 + r] * offset.y + m[8 + r] * offset.z + m[12 + r];
+        }
+        return view;
+    }
+
+    // the view after glMultMatrixf(matrix)
+    ViewState transformed(const GLfloat matrix[16]) const {
+        ViewState view = *this;
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                view.modelview[4 * column + row] =
+                    modelview[row] * matrix[4 * column] + modelview[4 + row] * matrix[4 * column + 1] +
+                    modelview[8 + row] * matrix[4 * column + 2] + modelview[12 + row] * matrix[4 * column + 3];
+            }
+        }
+        return view;
+    }
+
+    // pixels covered on screen by length (object space) at the nearest point
+    // of the sphere (center, radius). FLT_MAX if the sphere reaches the eye
+    float projectedSize(const Vec3f& center, float radius, float length) const {
+        const GLfloat* m = modelview;
+        // largest scale of the modelview matrix
+        float scale = std::max(std::max(
+            sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]),
+            sqrtf(m[4] * m[4] + m[5] * m[5] + m[6] * m[6])),
+            sqrtf(m[8] * m[8] + m[9] * m[9] + m[10] * m[10]));
+        float pixelsPerUnit = projection[5] * viewport[3] * 0.5f;
+        // orthographic: no division by the distance
+        if (projection[15] != 0.0f) return length * scale * pixelsPerUnit;
+        float eyeZ = m[2] * center.x + m[6] * center.y + m[10] * center.z + m[14];
+        float distance = -eyeZ - radius * scale;
+        if (distance <= 0.0f) return FLT_MAX;
+        return length * scale * pixelsPerUnit / distance;
+    }
+
+    bool isOrthographic() const {
+        return projection[15] != 0.0f;
+    }
+
+    // the planes of the view volume (left, right, bottom, top, near, far) in
+    // object space: inside is a x + b y + c z + d >= 0, (a, b, c) has length 1
+    void frustumPlanes(float planes[6][4]) const {
+        // rows of projection * modelview
+        float clip[4][4];
+        for (int row = 0; row < 4; row++) {
+            for (int column = 0; column < 4; column++) {
+                clip[row][column] = projection[row] * modelview[4 * column] +
+                                    projection[4 + row] * modelview[4 * column + 1] +
+                                    projection[8 + row] * modelview[4 * column + 2] +
+                                    projection[12 + row] * modelview[4 * column + 3];
+            }
+        }
+        for (int i = 0; i < 6; i++) {
+            float sign = (i & 1) ? -1.0f : 1.0f;
+            float* plane = planes[i];
+            for (int k = 0; k < 4; k++) plane[k] = clip[3][k] + sign * clip[i / 2][k];
+            float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length > 0.0f) {
+                for (int k = 0; k < 4; k++) plane[k] /= length;
+            }
+        }
+    }
+
+    // the eye in object space
+    Vec3f eyePosition() const {
+        return toObject(Vec3f(-modelview[12], -modelview[13], -modelview[14]));
+    }
+
+    // the direction the eye looks in, in object space and of length 1
+    Vec3f viewDirection() const {
+        return toObject(Vec3f(0.0f, 0.0f, -1.0f)).normalized();
+    }
+
+private:
+    // the vector that the linear part of the modelview matrix maps to v
+    Vec3f toObject(const Vec3f& v) const {
+        const GLfloat* m = modelview;
+        Vec3f c0(m[0], m[1], m[2]), c1(m[4], m[5], m[6]), c2(m[8], m[9], m[10]);
+        float det = c0 * (c1 ^ c2);
+        if (det == 0.0f) return Vec3f();
+        return Vec3f(v * (c1 ^ c2), c0 * (v ^ c2), c0 * (c1 ^ v)) / det;
+    }
+};
@@ -15,6 +15,8 @@
 #include <stdio.h>        // cout
 #include <iostream>       // cout
 #include "main.h"         // this header
+#include "TextureLoader.h"
+#include "GLStateCache.h"
 #include <algorithm>
 
 // ==============
@@ -28,6 +30,12 @@ int main(int argc, char** argv) {
 	glutInitWindowSize(600,400);
 	glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
 	glutCreateWindow("TU Darmstadt, GDV1, OpenGL P1");
+	// shaders and buffer objects need the entry points of the context
+	GLenum glewError = glewInit();
+	if (glewError != GLEW_OK) {
+		cout << "glewInit failed: " << glewGetErrorString(glewError) << endl;
+		return 1;
+	}
 	// link functions to certain openGL events
 	glutDisplayFunc(renderScene);
 	glutReshapeFunc(reshape);
@@ -50,11 +58,12 @@ int main(int argc, char** argv) {
 	unsigned int text_id;
 	trimesh.loadTexture(texture);
 	*/
-	meshObject.loadAddTriangleMesh(filename);
-	meshObject.loadAddTriangleMesh(filename1);
+	Scene::ObjectId object = scene.add();
+	scene.getObject(object).loadAddTriangleMesh(filename, texture);
+	scene.getObject(object).loadAddTriangleMesh(filename1, texture);
 	
 
-	//meshObject.setPosition(0, 0, 20);
+	//scene.setTransform(object, WorldTransform::translation(0, 0, 20));
 
 
 	// activate main loop
@@ -123,6 +132,10 @@ void processTimedEvent(int x) {
 		lightPos.rotY(lightMotionSpeed);
 		glutPostRedisplay();
 	}
+	// show the parts of meshes and textures that arrived in the meantime
+	else if (scene.isLoading() || TextureLoader::instance().isBusy()) {
+		glutPostRedisplay();
+	}
 }
 
 // =================
@@ -159,6 +172,9 @@ void drawLight() {
 }
 
 void renderScene() {
+	GLStateCache::instance().beginFrame();
+	// upload textures decoded in the background, a few ms per frame
+	TextureLoader::instance().uploadPending(4.0);
 	// clear and set camera
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glLoadIdentity();
@@ -177,7 +193,7 @@ void renderScene() {
 	glColor3f(1.0,1.0,1.0);
 	//glColor3f(0.2, 0.5, 0.8);
 	//trimesh.draw();
-	meshObject.draw();
+	scene.draw();
 	// swap buffers
 	glutSwapBuffers();
 }
@@ -212,6 +228,28 @@ void keyPressed(unsigned char key, int x, int y) {
 		break;
 	case 'm':
 	case 'M':
+		scene.forEachObject([](MeshObject& o) { o.switchDrawMode(); });
+		glutPostRedisplay();
+		break;
+	case 'i':
+	case 'I':
+		scene.forEachObject([](MeshObject& o) { o.switchVertexLayout(); });
+		glutPostRedisplay();
+		break;
+	case 'q':
+	case 'Q':
+		scene.forEachObject([](MeshObject& o) { o.switchQuantized(); });
+		glutPostRedisplay();
+		break;
+	case 's':
+	case 'S':
+		cout << "GL state changes last frame: " << GLStateCache::instance().lastFrame().issued << " issued, "
+			 << GLStateCache::instance().lastFrame().skipped << " skipped" << endl;
+		break;
+	case 'v':
+	case 'V':
+		cout << "objects last frame: " << scene.getCulling().visible << " visible, "
+			 << scene.getCulling().culled << " culled" << endl;
 		break;
 	}
 }
@@ -257,7 +295,11 @@ void coutHelp()
 	cout << "H: show this (H)elp file" << endl;
 	cout << "R: (R)eset view" << endl;
 	cout << "L: toggle (L)ight movement" << endl;
-	cout << "M: toggle draw (M)ode" << endl;
+	cout << "M: cycle draw (M)ode: immediate, vertex arrays, buffer objects, shaders" << endl;
+	cout << "I: toggle (I)nterleaved vertex layout" << endl;
+	cout << "Q: toggle (Q)uantized vertices" << endl;
+	cout << "S: print the GL (S)tate changes of the last frame" << endl;
+	cout << "V: print the (V)isible and culled objects of the last frame" << endl;
 	cout << "==========================" << endl;
 	cout << endl;
 }
@@ -12,10 +12,12 @@
 // ========================================================================= //
 
 #include <stdlib.h>       // namespace std
+#include <GL/glew.h>      // openGL extensions, include before gl.h
 #include <GL/glut.h>      // openGL helper
 #include "Vec3.h"         // basic vector arithmetic class (embedded in std::)
 #include "TriangleMesh.h" // simple class for reading and rendering triangle meshes
 #include "MeshObject.h"		// Multiple TriangleMeshes in on Object
+#include "Scene.h"			// MeshObjects with world transforms, culled by a hierarchy
 
 
 using namespace std;
@@ -38,7 +40,7 @@ float mouseSensitivy;
 int drawMode;
 // object
 TriangleMesh trimesh;
-MeshObject meshObject;
+Scene scene;
 
 // ==============
 // === BASICS ===